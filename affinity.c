@@ -0,0 +1,180 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mx/common.h"
+#include "mx/vector.h"
+#include "affinity.h"
+
+#define NODE_PATH "/sys/devices/system/node"
+
+/// The numastat counters of a node
+typedef struct _numastat_t
+{
+	unsigned long long local;  // local_node: pages for threads on the node
+	unsigned long long remote; // other_node: pages for threads on other nodes
+} numastat_t;
+
+static size_t *cpu_nodes;    // mx_vector_t of the node of each CPU
+static size_t **node_cpus;   // mx_vector_t of mx_vector_t of the CPUs of a node
+static numastat_t *baseline; // mx_vector_t of the counters of each node
+static cpu_set_t process_set; // the CPUs of the process before any pinning
+static bool is_process_set;
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+/// Read the counters of @a node; a node without numastat reads as zeros
+static numastat_t read_numastat(size_t node) {
+	numastat_t stat = { 0, 0 };
+	char path[PATH_MAX], name[64];
+	unsigned long long value;
+
+	snprintf(path, sizeof(path), NODE_PATH "/node%zu/numastat", node);
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+		return stat;
+	while (fscanf(file, "%63s %llu", name, &value) == 2) {
+		if (strcmp(name, "local_node") == 0)
+			stat.local = value;
+		else if (strcmp(name, "other_node") == 0)
+			stat.remote = value;
+	}
+	fclose(file);
+	return stat;
+}
+
+/// Add the CPUs of the cpulist (such as "0-3,8-11") of @a node
+static void read_cpulist(size_t node) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), NODE_PATH "/node%zu/cpulist", node);
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+		return;
+
+	unsigned long first, last;
+	int count;
+	while ((count = fscanf(file, "%lu-%lu", &first, &last)) >= 1) {
+		if (count == 1)
+			last = first;
+		for (size_t cpu = first; cpu <= last; cpu++) {
+			node_cpus[node] = mx_vector_append(node_cpus[node], &cpu);
+			while (mx_vector_length(cpu_nodes) <= cpu)
+				cpu_nodes = mx_vector_append(cpu_nodes, &node);
+			cpu_nodes[cpu] = node;
+		}
+		if (fgetc(file) != ',')
+			break;
+	}
+	fclose(file);
+}
+
+static void read_topology(void) {
+	// read before the first affinity_pin() as that pins the thread reading it
+	is_process_set = sched_getaffinity(0, sizeof(process_set), &process_set) == 0;
+
+	cpu_nodes = mx_vector_create(sizeof(size_t));
+	node_cpus = mx_vector_create(sizeof(size_t *));
+	baseline = mx_vector_create(sizeof(numastat_t));
+
+	size_t nodes = 0;
+	DIR *dirp = opendir(NODE_PATH);
+	struct dirent *dirent;
+	while (dirp != NULL && (dirent = readdir(dirp)) != NULL) {
+		unsigned long node;
+		char end;
+		if (sscanf(dirent->d_name, "node%lu%c", &node, &end) == 1)
+			nodes = MX_MAXIMUM(nodes, (size_t) node + 1);
+	}
+	if (dirp != NULL)
+		closedir(dirp);
+
+	for (size_t node = 0; node < nodes; node++) {
+		size_t *cpus = mx_vector_create(sizeof(size_t));
+		node_cpus = mx_vector_append(node_cpus, &cpus);
+		read_cpulist(node);
+		numastat_t stat = read_numastat(node);
+		baseline = mx_vector_append(baseline, &stat);
+	}
+
+	// without NUMA in sysfs every CPU is on node 0
+	if (nodes == 0 || mx_vector_length(cpu_nodes) == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_CONF);
+		if (nodes == 0) {
+			size_t *all = mx_vector_create(sizeof(size_t));
+			node_cpus = mx_vector_append(node_cpus, &all);
+			numastat_t stat = { 0, 0 };
+			baseline = mx_vector_append(baseline, &stat);
+		}
+		size_t node = 0;
+		for (size_t cpu = 0; cpu < (size_t) MX_MAXIMUM(cpus, 1L); cpu++) {
+			node_cpus[0] = mx_vector_append(node_cpus[0], &cpu);
+			cpu_nodes = mx_vector_append(cpu_nodes, &node);
+		}
+	}
+}
+
+size_t affinity_nodes(void) {
+	pthread_once(&topology_once, read_topology);
+	return mx_vector_length(node_cpus);
+}
+
+size_t affinity_node(void) {
+	pthread_once(&topology_once, read_topology);
+	int cpu = sched_getcpu();
+	if (cpu < 0 || (size_t) cpu >= mx_vector_length(cpu_nodes))
+		return 0;
+	return cpu_nodes[cpu];
+}
+
+bool affinity_pin(size_t worker) {
+	pthread_once(&topology_once, read_topology);
+
+	// deal workers to the nodes that have CPUs, then to the CPUs of each node
+	size_t *nodes = mx_vector_create(sizeof(size_t));
+	for (size_t node = 0; node < mx_vector_length(node_cpus); node++) {
+		if (mx_vector_length(node_cpus[node]) > 0)
+			nodes = mx_vector_append(nodes, &node);
+	}
+	size_t node = nodes[worker % mx_vector_length(nodes)];
+	size_t *cpus = node_cpus[node];
+	size_t cpu = cpus[worker / mx_vector_length(nodes) % mx_vector_length(cpus)];
+	mx_vector_delete(nodes);
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (error != 0) {
+		fprintf(stderr, "pthread_setaffinity_np() failed for CPU %zu: %s\n", cpu,
+			strerror(error));
+		return false;
+	}
+	return true;
+}
+
+void affinity_unpin(void) {
+	pthread_once(&topology_once, read_topology);
+	if (!is_process_set)
+		return;
+
+	int error = pthread_setaffinity_np(pthread_self(), sizeof(process_set),
+		&process_set);
+	if (error != 0)
+		fprintf(stderr, "pthread_setaffinity_np() failed: %s\n", strerror(error));
+}
+
+void affinity_print_stats(FILE *out) {
+	pthread_once(&topology_once, read_topology);
+
+	for (size_t node = 0; node < mx_vector_length(baseline); node++) {
+		numastat_t stat = read_numastat(node);
+		fprintf(out, "node %zu: %llu local, %llu cross-node page allocations\n",
+			node, stat.local - baseline[node].local,
+			stat.remote - baseline[node].remote);
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @brief Return the number of NUMA nodes
+ *
+ * Nodes are numbered as in /sys/devices/system/node; a machine without NUMA is
+ * one node. Node numbers may have gaps, in which case the missing nodes have
+ * no CPUs.
+ */
+size_t affinity_nodes(void);
+
+/// Return the NUMA node of the CPU the calling thread is running on
+size_t affinity_node(void);
+
+/**
+ * @brief Pin the calling thread, worker number @a worker, to a single CPU
+ *
+ * Workers are dealt to the nodes with CPUs in turn, so consecutive workers
+ * land on different nodes, and within a node to its CPUs in turn. Memory is
+ * placed on the node that first touches it, so buffers a pinned worker
+ * allocates and fills stay local to it. Threads created by a pinned thread
+ * inherit its CPU.
+ *
+ * @return whether the thread was pinned
+ */
+bool affinity_pin(size_t worker);
+
+/**
+ * @brief Let the calling thread run on any CPU of the process again
+ *
+ * A thread created by a pinned worker to serve every worker, rather than just
+ * its creator, calls this so it isn't confined to its creator's CPU.
+ */
+void affinity_unpin(void);
+
+/**
+ * @brief Print the page allocations of each NUMA node since the topology was
+ *        first read to @a out
+ *
+ * The counters are the kernel's numastat for the whole system: pages placed
+ * on the node for a thread running on it, and pages placed on it for a
+ * thread running on another node, which that thread then reads across the
+ * interconnect.
+ */
+void affinity_print_stats(FILE *out);
+
+#endif /* AFFINITY_H */
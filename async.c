@@ -0,0 +1,276 @@
+#define _GNU_SOURCE
+#include <aio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mx/common.h"
+#include "mx/map.h"
+#include "mx/string.h"
+#include "mx/vector.h"
+#include "async.h"
+#include "pool.h"
+#include "reader.h"
+
+typedef enum _state_t
+{
+	STATE_IDLE,    // the task has no file
+	STATE_READING, // a read of the file is in flight
+	STATE_HASHED,  // the digest of the file is final
+	STATE_FAILED,  // the file couldn't be read to the end
+} state_t;
+
+/**
+ * The hash of one file as a state machine. Each task owns two buffers: while
+ * the block that just arrived in one is hashed, the next block is read into
+ * the other.
+ */
+typedef struct _task_t
+{
+	state_t state;
+	size_t id;      // the index of the file in names
+	int fd;
+	off_t size;
+	off_t offset;   // the offset of the read in flight
+	uint64_t digest;
+	unsigned char *buffers[2];
+	size_t current; // the buffer the read in flight fills
+	struct aiocb block;
+} task_t;
+
+typedef struct _group_key_t
+{
+	off_t size;
+	uint64_t digest;
+} group_key_t;
+
+static pool_t *pool;
+
+static void submit(task_t *task) {
+	memset(&task->block, 0, sizeof(task->block));
+	task->block.aio_fildes = task->fd;
+	task->block.aio_buf = task->buffers[task->current];
+	task->block.aio_nbytes = MX_MINIMUM((off_t) pool_buffer_size(pool),
+		task->size - task->offset);
+	task->block.aio_offset = task->offset;
+	task->block.aio_sigevent.sigev_notify = SIGEV_NONE;
+
+	while (aio_read(&task->block) != 0) {
+		if (errno != EAGAIN) {
+			fprintf(stderr, "aio_read() failed: %s\n", strerror(errno));
+			exit(1);
+		}
+	}
+	task->state = STATE_READING;
+}
+
+/// Start hashing the file @a id of @a names with @a task
+static bool start(task_t *task, mx_string_t *names, size_t id, off_t size) {
+	if ((task->fd = open(names[id], O_RDONLY | O_CLOEXEC)) < 0) {
+		fprintf(stderr, "open() failed on %s: %s\n", names[id], strerror(errno));
+		return false;
+	}
+
+	task->id = id;
+	task->size = size;
+	task->offset = 0;
+	task->digest = MX_FNV1A_BASIS;
+	task->current = 0;
+	submit(task);
+	return true;
+}
+
+/**
+ * Advance @a task whose read completed: queue the next read first, then hash
+ * the block that arrived. The task ends up reading, hashed or failed.
+ */
+static void resume(task_t *task, mx_string_t *names) {
+	ssize_t count = aio_return(&task->block);
+	if (count <= 0) {
+		fprintf(stderr, "reading %s failed: %s\n", names[task->id],
+			count < 0 ? strerror(errno) : "file shrank");
+		task->state = STATE_FAILED;
+		return;
+	}
+
+	unsigned char *arrived = task->buffers[task->current];
+	task->offset += count;
+
+	if (task->offset < task->size) {
+		task->current ^= 1;
+		submit(task);
+	} else
+		task->state = STATE_HASHED;
+
+	task->digest = mx_fnv1a_extend(task->digest, (char *) arrived, count);
+}
+
+/// Append @a id to the group of @a size and @a digest
+static void enlist(mx_map_t groups, off_t size, uint64_t digest, size_t id) {
+	group_key_t key = { .size = size, .digest = digest };
+	size_t **ids = mx_map_get(groups, &key);
+	if (ids == NULL) {
+		size_t *empty = mx_vector_create(sizeof(size_t));
+		if ((ids = mx_map_put(groups, &key, &empty)) == NULL)
+			abort();
+	}
+	*ids = mx_vector_append(*ids, &id);
+}
+
+/// Print the classes of identical files among the @a length files @a ids
+static void print_verified(mx_string_t *names, size_t *ids, size_t length) {
+	char **group = malloc(length * sizeof(char *));
+	size_t *classes = malloc(length * sizeof(size_t));
+	if (group == NULL || classes == NULL)
+		abort();
+	for (size_t j = 0; j < length; j++)
+		group[j] = names[ids[j]];
+	is_same_files(group, length, classes);
+
+	for (size_t j = 0; j < length; j++) {
+		if (classes[j] != j)
+			continue;
+		size_t count = 0;
+		for (size_t k = j; k < length; k++)
+			count += classes[k] == j;
+		if (count < 2)
+			continue;
+		for (size_t k = j; k < length; k++) {
+			if (classes[k] == j)
+				printf(k == j ? "%s" : ", %s", group[k]);
+		}
+		printf("\n");
+	}
+
+	free(classes);
+	free(group);
+}
+
+int async_main(mx_string_t *names, size_t in_flight) {
+	size_t names_length = mx_vector_length(names);
+	in_flight = MX_MAXIMUM(in_flight, (size_t) 1);
+
+	// only files sharing a size need hashing
+	off_t *sizes = mx_vector_create_with(sizeof(off_t), names_length);
+	mx_map_t counts = mx_map_create(sizeof(off_t), sizeof(size_t), NULL, NULL);
+	for (size_t i = 0; i < names_length; i++) {
+		struct stat st;
+		sizes[i] = stat(names[i], &st) == 0 && S_ISREG(st.st_mode) ? st.st_size : -1;
+		if (sizes[i] < 0)
+			continue;
+
+		size_t *count = mx_map_get(counts, &sizes[i]);
+		if (count == NULL) {
+			size_t zero = 0;
+			if ((count = mx_map_put(counts, &sizes[i], &zero)) == NULL)
+				abort();
+		}
+		(*count)++;
+	}
+
+	// glibc serves POSIX AIO from a pool of its own threads, 20 unless told
+	// otherwise, so give it one per task for every read to really be in flight
+	struct aioinit init = {
+		.aio_threads = (int) MX_MINIMUM(in_flight, (size_t) INT_MAX),
+		.aio_num = (int) MX_MINIMUM(in_flight, (size_t) INT_MAX),
+		.aio_idle_time = 1,
+	};
+	aio_init(&init);
+
+	size_t size = (reader_config.buffer_size + 4095) / 4096 * 4096;
+	if ((pool = pool_create(MX_MAXIMUM(size, (size_t) 4096), 4096)) == NULL)
+		abort();
+
+	task_t *tasks = calloc(in_flight, sizeof(task_t));
+	const struct aiocb **blocks = calloc(in_flight, sizeof(struct aiocb *));
+	if (tasks == NULL || blocks == NULL)
+		abort();
+	for (size_t t = 0; t < in_flight; t++) {
+		tasks[t].state = STATE_IDLE;
+		tasks[t].buffers[0] = pool_acquire(pool);
+		tasks[t].buffers[1] = pool_acquire(pool);
+	}
+
+	mx_map_t groups = mx_map_create(sizeof(group_key_t), sizeof(size_t *), NULL, NULL);
+	size_t next = 0, active = 0;
+
+	while (true) {
+		// hand the next files to idle tasks; an empty file needs no read
+		for (size_t t = 0; t < in_flight && next < names_length; t++) {
+			if (tasks[t].state != STATE_IDLE)
+				continue;
+
+			for (; next < names_length; next++) {
+				size_t *count = sizes[next] < 0 ? NULL : mx_map_get(counts, &sizes[next]);
+				if (count == NULL || *count < 2)
+					continue;
+
+				if (sizes[next] == 0) {
+					enlist(groups, 0, MX_FNV1A_BASIS, next);
+					continue;
+				}
+
+				if (start(&tasks[t], names, next, sizes[next])) {
+					active++;
+					next++;
+					break;
+				}
+			}
+		}
+		if (active == 0)
+			break;
+
+		for (size_t t = 0; t < in_flight; t++)
+			blocks[t] = tasks[t].state == STATE_READING ? &tasks[t].block : NULL;
+		if (aio_suspend(blocks, in_flight, NULL) != 0 && errno != EINTR) {
+			fprintf(stderr, "aio_suspend() failed: %s\n", strerror(errno));
+			exit(1);
+		}
+
+		// resume every task whose read completed, in any order
+		for (size_t t = 0; t < in_flight; t++) {
+			task_t *task = &tasks[t];
+			if (task->state != STATE_READING || aio_error(&task->block) == EINPROGRESS)
+				continue;
+
+			resume(task, names);
+			if (task->state == STATE_READING)
+				continue;
+
+			if (task->state == STATE_HASHED)
+				enlist(groups, task->size, task->digest, task->id);
+			close(task->fd);
+			task->state = STATE_IDLE;
+			active--;
+		}
+	}
+
+	// a shared digest only nominates a set; its files are confirmed byte for
+	// byte and printed as the classes of identical files they split into
+	for (size_t i = 0; (i = mx_map_next(groups, i)) != MX_ABSENT; i++) {
+		size_t *ids = *(size_t **) mx_map_value_at(groups, i);
+		size_t length = mx_vector_length(ids);
+		if (length >= 2)
+			print_verified(names, ids, length);
+		mx_vector_delete(ids);
+	}
+
+	for (size_t t = 0; t < in_flight; t++) {
+		pool_release(pool, tasks[t].buffers[0]);
+		pool_release(pool, tasks[t].buffers[1]);
+	}
+	pool_delete(pool);
+	free(blocks);
+	free(tasks);
+	mx_map_delete(groups);
+	mx_map_delete(counts);
+	mx_vector_delete(sizes);
+	return 0;
+}
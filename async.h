@@ -0,0 +1,26 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <stddef.h>
+
+#include "mx/string.h"
+
+/**
+ * @brief Print the duplicate sets of @a names, hashing from a single thread
+ *
+ * Files that share a size are hashed by resumable tasks, each a small state
+ * machine over POSIX asynchronous reads. Up to @a in_flight tasks have a read
+ * outstanding at once and whichever read completes next is hashed while the
+ * task's following read is already in flight, so one hashing thread keeps the
+ * disk busy instead of blocking on each read in turn. glibc performs the
+ * reads with blocking pread() calls on a pool of its own threads, which is
+ * sized with aio_init() to @a in_flight threads so every outstanding read is
+ * in flight rather than queued. Once every file is hashed,
+ * the files sharing a size and digest are confirmed with is_same_files() and
+ * each class of identical files is printed as "name_1, name_2, ...".
+ *
+ * @return the exit status
+ */
+int async_main(mx_string_t *names, size_t in_flight);
+
+#endif /* ASYNC_H */
@@ -0,0 +1,126 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+/**
+ * @brief Compare the files @a fd_1 and @a fd_2 of @a size bytes @a rounds
+ *        times through two buffers of @a pool
+ *
+ * @return the seconds taken
+ */
+double compare(pool_t *pool, int fd_1, int fd_2, off_t size, size_t rounds) {
+	size_t buffer_size = pool_buffer_size(pool);
+	unsigned char *buffer_1 = pool_acquire(pool);
+	unsigned char *buffer_2 = pool_acquire(pool);
+
+	// fault the buffers in before timing
+	memset(buffer_1, 0, buffer_size);
+	memset(buffer_2, 0, buffer_size);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t round = 0; round < rounds; round++) {
+		for (off_t offset = 0; offset < size; offset += buffer_size) {
+			size_t count = size - offset < (off_t) buffer_size ? (size_t) (size - offset) : buffer_size;
+			if (pread(fd_1, buffer_1, count, offset) != (ssize_t) count ||
+					pread(fd_2, buffer_2, count, offset) != (ssize_t) count) {
+				fprintf(stderr, "pread() failed: %s\n", strerror(errno));
+				exit(1);
+			}
+			if (memcmp(buffer_1, buffer_2, count) != 0) {
+				fprintf(stderr, "the files differ; compare a file with a copy\n");
+				exit(1);
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	pool_release(pool, buffer_1);
+	pool_release(pool, buffer_2);
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int open_file(char *name, off_t *size) {
+	int fd = open(name, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "open() failed on %s: %s\n", name, strerror(errno));
+		exit(1);
+	}
+	*size = st.st_size;
+	return fd;
+}
+
+void usage(char *program) {
+	fprintf(stderr, "usage: %s [-b KiB] [-r rounds] file copy\n", program);
+	fprintf(stderr, "  -b  compare through buffers of this many KiB (default 8192)\n");
+	fprintf(stderr, "  -r  compare the files this many times (default 8)\n");
+	exit(2);
+}
+
+/**
+ * Compare a file with its copy from the page cache through heap buffers then
+ * through buffers carved from huge pages, and print the throughput of each
+ */
+int main(int argc, char **argv)
+{
+	size_t buffer_size = 8 << 20;
+	size_t rounds = 8;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "b:r:")) != -1) {
+		switch (opt) {
+		case 'b':
+			buffer_size = strtoul(optarg, NULL, 10) * 1024;
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2 || buffer_size == 0 || rounds == 0)
+		usage(argv[0]);
+
+	off_t size_1, size_2;
+	int fd_1 = open_file(argv[optind], &size_1);
+	int fd_2 = open_file(argv[optind + 1], &size_2);
+	if (size_1 != size_2) {
+		fprintf(stderr, "the files differ in size; compare a file with a copy\n");
+		exit(1);
+	}
+
+	char *backings[] = {
+		[POOL_HEAP] = "heap",
+		[POOL_HUGETLB] = "reserved huge pages",
+		[POOL_THP] = "transparent huge pages",
+		[POOL_PAGES] = "plain pages",
+	};
+	pool_t *pools[] = {
+		pool_create(buffer_size, 4096),
+		pool_create_huge(buffer_size, 4096),
+	};
+
+	// warm the page cache so both runs compare from memory
+	compare(pools[0], fd_1, fd_2, size_1, 1);
+
+	for (size_t i = 0; i < sizeof(pools) / sizeof(*pools); i++) {
+		double seconds = compare(pools[i], fd_1, fd_2, size_1, rounds);
+		double mib = 2.0 * size_1 * rounds / (1 << 20);
+		printf("%-24s %8.0f MiB/s\n", backings[pool_backing(pools[i])], mib / seconds);
+		pool_delete(pools[i]);
+	}
+
+	close(fd_1);
+	close(fd_2);
+	return 0;
+}
@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mx/bitset.h"
+#include "mx/common.h"
+
+/// Return the seconds since @a start
+double elapsed(struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/// Set about half of the bits of @a bitset from the xorshift @a state
+void fill(mx_bitset_t bitset, uint64_t state) {
+	mx_bitset_zero(bitset);
+	for (size_t i = 0; i < mx_bitset_volume(bitset); i++) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		if (state & 1)
+			mx_bitset_set(bitset, i);
+	}
+}
+
+void usage(char *program) {
+	fprintf(stderr, "usage: %s [-m Mbits] [-r rounds]\n", program);
+	fprintf(stderr, "  -m  time bitsets of this many million bits (default 100)\n");
+	fprintf(stderr, "  -r  run each operation this many times (default 20)\n");
+	exit(2);
+}
+
+/**
+ * Time the bulk operations, population counts and walks over the set bits of
+ * two large bitsets and print the seconds each took
+ */
+int main(int argc, char **argv)
+{
+	size_t volume = 100000000;
+	size_t rounds = 20;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "m:r:")) != -1) {
+		switch (opt) {
+		case 'm':
+			volume = strtoul(optarg, NULL, 10) * 1000000;
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || volume == 0 || rounds == 0)
+		usage(argv[0]);
+
+	mx_bitset_t a = mx_bitset_create(volume);
+	mx_bitset_t b = mx_bitset_create(volume);
+	if (a == NULL || b == NULL) {
+		fprintf(stderr, "mx_bitset_create() failed for %zu bits\n", volume);
+		exit(1);
+	}
+	fill(a, UINT64_C(0x9e3779b97f4a7c15));
+	fill(b, UINT64_C(0xd1b54a32d192ed03));
+
+	// the operations depend on the previous result so none can be skipped
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t round = 0; round < rounds; round++) {
+		mx_bitset_and(a, b);
+		mx_bitset_or(a, b);
+		mx_bitset_xor(a, b);
+		mx_bitset_xor(a, b);
+	}
+	printf("%zu bulk ops    %8.3f s\n", 4 * rounds, elapsed(&start));
+
+	size_t count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t round = 0; round < rounds; round++)
+		count += mx_bitset_popcnt(a);
+	printf("%zu popcnts     %8.3f s\n", rounds, elapsed(&start));
+
+	size_t walked = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t i = 0; (i = mx_bitset_next(a, i)) != MX_ABSENT; i++)
+		walked++;
+	printf("1 walk         %8.3f s\n", elapsed(&start));
+
+	// keep the results live and check that the walk and the counts agree
+	if (walked * rounds != count) {
+		fprintf(stderr, "walked %zu bits but counted %zu\n", walked, count / rounds);
+		exit(1);
+	}
+
+	mx_bitset_delete(a);
+	mx_bitset_delete(b);
+	return 0;
+}
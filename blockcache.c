@@ -0,0 +1,161 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mx/common.h"
+#include "mx/map.h"
+#include "blockcache.h"
+
+#define SHARDS 16
+
+typedef struct _block_key_t
+{
+	size_t id;
+	size_t index;
+} block_key_t;
+
+typedef struct _slot_t
+{
+	block_key_t key;
+	size_t length;
+	bool is_used;
+	bool is_referenced;
+} slot_t;
+
+typedef struct _shard_t
+{
+	pthread_mutex_t mutex;
+	mx_map_t map;   // block_key_t -> slot
+	slot_t *slots;
+	char *data;     // the block of slot i is at data + i * block_size
+	size_t volume;  // number of slots
+	size_t hand;    // the next slot the clock looks at
+	size_t hits;
+	size_t misses;
+} shard_t;
+
+struct _blockcache_t
+{
+	size_t block_size;
+	shard_t shards[SHARDS];
+};
+
+static shard_t *find_shard(blockcache_t *cache, block_key_t *key) {
+	return &cache->shards[mx_fnv1a((char *) key, sizeof(*key)) % SHARDS];
+}
+
+blockcache_t *blockcache_create(size_t volume, size_t block_size) {
+	blockcache_t *cache = calloc(1, sizeof(blockcache_t));
+	if (cache == NULL)
+		return NULL;
+
+	cache->block_size = block_size;
+	size_t shard_volume = MX_MAXIMUM(volume / block_size / SHARDS, (size_t) 1);
+
+	for (size_t i = 0; i < SHARDS; i++) {
+		shard_t *shard = &cache->shards[i];
+		pthread_mutex_init(&shard->mutex, NULL);
+		shard->map = mx_map_create(sizeof(block_key_t), sizeof(size_t), NULL, NULL);
+		shard->slots = calloc(shard_volume, sizeof(slot_t));
+		shard->data = malloc(shard_volume * block_size);
+		shard->volume = shard_volume;
+		if (shard->map == NULL || shard->slots == NULL || shard->data == NULL) {
+			blockcache_delete(cache);
+			return NULL;
+		}
+	}
+
+	return cache;
+}
+
+void blockcache_delete(blockcache_t *cache) {
+	for (size_t i = 0; i < SHARDS; i++) {
+		shard_t *shard = &cache->shards[i];
+		if (shard->map != NULL)
+			mx_map_delete(shard->map);
+		free(shard->slots);
+		free(shard->data);
+		pthread_mutex_destroy(&shard->mutex);
+	}
+	free(cache);
+}
+
+bool blockcache_get(blockcache_t *cache, size_t id, size_t index, void *buffer,
+		size_t *length) {
+	block_key_t key = { .id = id, .index = index };
+	shard_t *shard = find_shard(cache, &key);
+
+	pthread_mutex_lock(&shard->mutex);
+	size_t *i = mx_map_get(shard->map, &key);
+	if (i == NULL) {
+		shard->misses++;
+		pthread_mutex_unlock(&shard->mutex);
+		return false;
+	}
+
+	slot_t *slot = &shard->slots[*i];
+	slot->is_referenced = true;
+	*length = slot->length;
+	memcpy(buffer, shard->data + *i * cache->block_size, slot->length);
+	shard->hits++;
+	pthread_mutex_unlock(&shard->mutex);
+	return true;
+}
+
+void blockcache_put(blockcache_t *cache, size_t id, size_t index,
+		const void *buffer, size_t length) {
+	block_key_t key = { .id = id, .index = index };
+	shard_t *shard = find_shard(cache, &key);
+
+	pthread_mutex_lock(&shard->mutex);
+
+	// another worker may have read the same block in the meantime
+	if (mx_map_get(shard->map, &key) != NULL) {
+		pthread_mutex_unlock(&shard->mutex);
+		return;
+	}
+
+	// sweep the clock hand past referenced slots, giving each a second chance
+	while (shard->slots[shard->hand].is_used &&
+			shard->slots[shard->hand].is_referenced) {
+		shard->slots[shard->hand].is_referenced = false;
+		shard->hand = (shard->hand + 1) % shard->volume;
+	}
+
+	size_t i = shard->hand;
+	slot_t *slot = &shard->slots[i];
+	if (slot->is_used)
+		mx_map_remove(shard->map, &slot->key);
+
+	*slot = (slot_t) {
+		.key = key, .length = MX_MINIMUM(length, cache->block_size),
+		.is_used = true, .is_referenced = false,
+	};
+	memcpy(shard->data + i * cache->block_size, buffer, slot->length);
+	if (mx_map_put(shard->map, &key, &i) == NULL)
+		slot->is_used = false;
+	shard->hand = (shard->hand + 1) % shard->volume;
+
+	pthread_mutex_unlock(&shard->mutex);
+}
+
+size_t blockcache_hits(blockcache_t *cache) {
+	size_t hits = 0;
+	for (size_t i = 0; i < SHARDS; i++) {
+		pthread_mutex_lock(&cache->shards[i].mutex);
+		hits += cache->shards[i].hits;
+		pthread_mutex_unlock(&cache->shards[i].mutex);
+	}
+	return hits;
+}
+
+size_t blockcache_misses(blockcache_t *cache) {
+	size_t misses = 0;
+	for (size_t i = 0; i < SHARDS; i++) {
+		pthread_mutex_lock(&cache->shards[i].mutex);
+		misses += cache->shards[i].misses;
+		pthread_mutex_unlock(&cache->shards[i].mutex);
+	}
+	return misses;
+}
@@ -0,0 +1,42 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct _blockcache_t blockcache_t;
+
+/**
+ * @brief Allocate and initialize a cache of blocks of @a block_size bytes using
+ *        at most @a volume bytes
+ *
+ * Blocks are keyed by (file id, block index) and spread over shards with a lock
+ * each so that workers rarely contend. Each shard evicts with the clock
+ * algorithm.
+ *
+ * @return the cache on success; otherwise NULL
+ */
+blockcache_t *blockcache_create(size_t volume, size_t block_size);
+
+/// Deallocate the @a cache and every block in it
+void blockcache_delete(blockcache_t *cache);
+
+/**
+ * @brief Copy block @a index of the file @a id into @a buffer if it is cached
+ *
+ * @return whether the block was cached; its length is stored in @a length
+ */
+bool blockcache_get(blockcache_t *cache, size_t id, size_t index, void *buffer,
+	size_t *length);
+
+/// Copy @a length bytes at @a buffer into the @a cache as block @a index of @a id
+void blockcache_put(blockcache_t *cache, size_t id, size_t index,
+	const void *buffer, size_t length);
+
+/// Return the number of blockcache_get() calls that found their block
+size_t blockcache_hits(blockcache_t *cache);
+
+/// Return the number of blockcache_get() calls that didn't find their block
+size_t blockcache_misses(blockcache_t *cache);
+
+#endif /* BLOCKCACHE_H */
@@ -0,0 +1,429 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "mx/common.h"
+#include "mx/map.h"
+#include "mx/string.h"
+#include "mx/vector.h"
+#include "catalog.h"
+#include "layout.h"
+#include "reader.h"
+
+typedef struct _group_key_t
+{
+	off_t size;
+	uint64_t digest;
+} group_key_t;
+
+typedef struct _keyed_id_t
+{
+	layout_key_t key;
+	size_t id;
+} keyed_id_t;
+
+static uint64_t path_hash(const void *x) {
+	return mx_string_hash(*(mx_string_t *) x);
+}
+
+static int path_eq(const void *a, const void *b) {
+	return mx_string_eq(*(mx_string_t *) a, *(mx_string_t *) b);
+}
+
+static int id_eq(const void *a, const void *b) {
+	return *(size_t *) a == *(size_t *) b;
+}
+
+/// Remove @a id from the vector of ids in @a map under @a key
+static void unlist(mx_map_t map, const void *key, size_t id) {
+	size_t **ids = mx_map_get(map, key);
+	if (ids == NULL)
+		return;
+
+	size_t i = mx_vector_find(*ids, id_eq, &id);
+	if (i != MX_ABSENT)
+		*ids = mx_vector_remove(*ids, i);
+
+	if (mx_vector_length(*ids) == 0) {
+		mx_vector_delete(*ids);
+		mx_map_remove(map, key);
+	}
+}
+
+/// Append @a id to the vector of ids in @a map under @a key
+static size_t *enlist(mx_map_t map, const void *key, size_t id) {
+	size_t **ids = mx_map_get(map, key);
+	if (ids == NULL) {
+		size_t *empty = mx_vector_create(sizeof(size_t));
+		if ((ids = mx_map_put(map, key, &empty)) == NULL)
+			abort();
+	}
+
+	size_t *appended = mx_vector_append(*ids, &id);
+	if (appended == NULL)
+		abort();
+	return *ids = appended;
+}
+
+static bool hash_record(catalog_t *catalog, size_t id) {
+	record_t *record = &catalog->records[id];
+
+	if (!file_digest(record->path, &record->digest))
+		return false;
+	record->is_hashed = true;
+
+	group_key_t key = { .size = record->size, .digest = record->digest };
+	enlist(catalog->groups, &key, id);
+	return true;
+}
+
+/// Remove the record @a id from its size bucket and its group
+static void detach(catalog_t *catalog, size_t id) {
+	record_t *record = &catalog->records[id];
+
+	unlist(catalog->sizes, &record->size, id);
+
+	if (record->is_hashed) {
+		group_key_t key = { .size = record->size, .digest = record->digest };
+		unlist(catalog->groups, &key, id);
+		record->is_hashed = false;
+	}
+}
+
+static void release(catalog_t *catalog, size_t id) {
+	detach(catalog, id);
+
+	record_t *record = &catalog->records[id];
+	mx_map_remove(catalog->paths, &record->path);
+	mx_string_delete(record->path);
+	record->path = NULL;
+	record->is_live = false;
+
+	catalog->free_ids = mx_vector_append(catalog->free_ids, &id);
+}
+
+/**
+ * Add the record @a id to its size bucket. The first time a bucket holds two
+ * records every unhashed record in it is hashed and grouped, unless hashing is
+ * deferred. Records whose file can't be hashed anymore are released.
+ */
+static void attach(catalog_t *catalog, size_t id) {
+	off_t size = catalog->records[id].size;
+	enlist(catalog->sizes, &size, id);
+
+	size_t **bucket = mx_map_get(catalog->sizes, &size);
+	if (mx_vector_length(*bucket) < 2 || catalog->is_deferred)
+		return;
+
+	for (size_t i = 0; i < mx_vector_length(*bucket);) {
+		size_t other = (*bucket)[i];
+		if (catalog->records[other].is_hashed || hash_record(catalog, other)) {
+			i++;
+			continue;
+		}
+
+		// release() unlists other from the bucket which may delete the bucket
+		bool is_last = mx_vector_length(*bucket) == 1;
+		release(catalog, other);
+		if (is_last)
+			return;
+	}
+}
+
+catalog_t *catalog_create(void) {
+	catalog_t *catalog = malloc(sizeof(catalog_t));
+	if (catalog == NULL)
+		return NULL;
+
+	catalog->records = mx_vector_create(sizeof(record_t));
+	catalog->free_ids = mx_vector_create(sizeof(size_t));
+	catalog->paths = mx_map_create(sizeof(mx_string_t), sizeof(size_t),
+		path_hash, path_eq);
+	catalog->sizes = mx_map_create(sizeof(off_t), sizeof(size_t *), NULL, NULL);
+	catalog->groups = mx_map_create(sizeof(group_key_t), sizeof(size_t *),
+		NULL, NULL);
+	catalog->is_deferred = false;
+	catalog->generation = 0;
+	catalog->is_cancelled = NULL;
+
+	return catalog;
+}
+
+void catalog_delete(catalog_t *catalog) {
+	for (size_t i = 0; i < mx_vector_length(catalog->records); i++) {
+		if (catalog->records[i].is_live)
+			mx_string_delete(catalog->records[i].path);
+	}
+
+	for (size_t i = 0; (i = mx_map_next(catalog->sizes, i)) != MX_ABSENT; i++)
+		mx_vector_delete(*(size_t **) mx_map_value_at(catalog->sizes, i));
+	for (size_t i = 0; (i = mx_map_next(catalog->groups, i)) != MX_ABSENT; i++)
+		mx_vector_delete(*(size_t **) mx_map_value_at(catalog->groups, i));
+
+	mx_map_delete(catalog->paths);
+	mx_map_delete(catalog->sizes);
+	mx_map_delete(catalog->groups);
+	mx_vector_delete(catalog->free_ids);
+	mx_vector_delete(catalog->records);
+	free(catalog);
+}
+
+size_t catalog_find(catalog_t *catalog, char *path) {
+	mx_string_t key = mx_string_create(path, 0);
+	size_t *id = mx_map_get(catalog->paths, &key);
+	mx_string_delete(key);
+	return id == NULL ? MX_ABSENT : *id;
+}
+
+size_t catalog_update(catalog_t *catalog, char *path) {
+	size_t id = catalog_find(catalog, path);
+
+	struct stat st;
+	if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+		if (id != MX_ABSENT)
+			release(catalog, id);
+		return MX_ABSENT;
+	}
+
+	if (id != MX_ABSENT) {
+		record_t *record = &catalog->records[id];
+		record->generation = catalog->generation;
+		if (record->dev == st.st_dev && record->ino == st.st_ino &&
+				record->size == st.st_size &&
+				record->mtime.tv_sec == st.st_mtim.tv_sec &&
+				record->mtime.tv_nsec == st.st_mtim.tv_nsec)
+			return id;
+		detach(catalog, id);
+	} else {
+		record_t record = {
+			.path = mx_string_create(path, 0),
+			.is_live = true,
+			.generation = catalog->generation,
+		};
+
+		if (mx_vector_length(catalog->free_ids) > 0) {
+			catalog->free_ids = mx_vector_pull(catalog->free_ids, &id);
+			catalog->records[id] = record;
+		} else {
+			id = mx_vector_length(catalog->records);
+			catalog->records = mx_vector_append(catalog->records, &record);
+		}
+
+		if (mx_map_put(catalog->paths, &record.path, &id) == NULL)
+			abort();
+	}
+
+	record_t *record = &catalog->records[id];
+	record->dev = st.st_dev;
+	record->ino = st.st_ino;
+	record->size = st.st_size;
+	record->mtime = st.st_mtim;
+
+	attach(catalog, id);
+
+	return catalog->records[id].is_live ? id : MX_ABSENT;
+}
+
+static bool is_cancelled(catalog_t *catalog) {
+	return catalog->is_cancelled != NULL && atomic_load(catalog->is_cancelled);
+}
+
+/**
+ * Pass every class of two or more identical files of the group @a ids to
+ * @a set. A group only shares a size and a digest, so its files are compared
+ * byte for byte with is_same_files() first.
+ */
+static void confirm_group(catalog_t *catalog, size_t *ids, catalog_set_f set,
+		void *data) {
+	size_t length = mx_vector_length(ids);
+	char **names = malloc(length * sizeof(char *));
+	size_t *classes = malloc(length * sizeof(size_t));
+	if (names == NULL || classes == NULL)
+		abort();
+	for (size_t i = 0; i < length; i++)
+		names[i] = catalog->records[ids[i]].path;
+	is_same_files(names, length, classes);
+
+	size_t *members = mx_vector_create(sizeof(size_t));
+	for (size_t i = 0; i < length; i++) {
+		if (classes[i] != i)
+			continue;
+		members = mx_vector_truncate(members, 0);
+		for (size_t j = i; j < length; j++) {
+			if (classes[j] == i)
+				members = mx_vector_append(members, &ids[j]);
+		}
+		if (mx_vector_length(members) >= 2)
+			set(data, catalog, members);
+	}
+
+	mx_vector_delete(members);
+	free(classes);
+	free(names);
+}
+
+/// Pass every duplicate set of records of @a size to @a set
+static void pass_sets(catalog_t *catalog, off_t size, catalog_set_f set,
+		void *data) {
+	size_t **bucket = mx_map_get(catalog->sizes, &size);
+	if (bucket == NULL)
+		return;
+
+	for (size_t i = 0; i < mx_vector_length(*bucket) && !is_cancelled(catalog); i++) {
+		record_t *record = &catalog->records[(*bucket)[i]];
+		if (!record->is_hashed)
+			continue;
+
+		// a group is passed once, when its first record is reached
+		group_key_t key = { .size = size, .digest = record->digest };
+		size_t *ids = *(size_t **) mx_map_get(catalog->groups, &key);
+		if (ids[0] == (*bucket)[i] && mx_vector_length(ids) >= 2)
+			confirm_group(catalog, ids, set, data);
+	}
+}
+
+void catalog_flush(catalog_t *catalog) {
+	catalog_flush_sets(catalog, NULL, NULL);
+}
+
+bool catalog_flush_sets(catalog_t *catalog, catalog_set_f set, void *data) {
+	catalog->is_deferred = false;
+
+	keyed_id_t *pending = mx_vector_create(sizeof(keyed_id_t));
+	mx_map_t unhashed = mx_map_create(sizeof(off_t), sizeof(size_t), NULL, NULL);
+	off_t *complete = mx_vector_create(sizeof(off_t));
+
+	for (size_t i = 0; (i = mx_map_next(catalog->sizes, i)) != MX_ABSENT; i++) {
+		off_t size = *(off_t *) mx_map_key_at(catalog->sizes, i);
+		size_t *ids = *(size_t **) mx_map_value_at(catalog->sizes, i);
+		if (mx_vector_length(ids) < 2)
+			continue;
+
+		size_t count = 0;
+		for (size_t j = 0; j < mx_vector_length(ids); j++) {
+			record_t *record = &catalog->records[ids[j]];
+			if (record->is_hashed)
+				continue;
+			keyed_id_t keyed = { .key = layout_key(record->path), .id = ids[j] };
+			pending = mx_vector_append(pending, &keyed);
+			count++;
+		}
+
+		if (count == 0)
+			complete = mx_vector_append(complete, &size);
+		else if (mx_map_put(unhashed, &size, &count) == NULL)
+			abort();
+	}
+
+	bool result = true;
+	for (size_t i = 0; set != NULL && i < mx_vector_length(complete); i++) {
+		if (is_cancelled(catalog)) {
+			result = false;
+			break;
+		}
+		pass_sets(catalog, complete[i], set, data);
+	}
+
+	// the key is the first member so layout_cmp() orders keyed ids as well
+	mx_vector_sort(pending, layout_cmp);
+
+	for (size_t i = 0; result && i < mx_vector_length(pending); i++) {
+		if (is_cancelled(catalog)) {
+			result = false;
+			break;
+		}
+
+		size_t id = pending[i].id;
+		off_t size = catalog->records[id].size;
+		if (catalog->records[id].is_live && !hash_record(catalog, id))
+			release(catalog, id);
+
+		size_t *count = mx_map_get(unhashed, &size);
+		if (--*count == 0 && set != NULL)
+			pass_sets(catalog, size, set, data);
+	}
+
+	mx_vector_delete(complete);
+	mx_map_delete(unhashed);
+	mx_vector_delete(pending);
+	return result && !is_cancelled(catalog);
+}
+
+void catalog_remove(catalog_t *catalog, char *path) {
+	size_t id = catalog_find(catalog, path);
+	if (id != MX_ABSENT)
+		release(catalog, id);
+}
+
+void catalog_remove_tree(catalog_t *catalog, char *path) {
+	size_t length = strlen(path);
+
+	for (size_t i = 0; (i = mx_map_next(catalog->paths, i)) != MX_ABSENT; i++) {
+		mx_string_t key = *(mx_string_t *) mx_map_key_at(catalog->paths, i);
+		if (strncmp(key, path, length) != 0)
+			continue;
+		if (key[length] != '\0' && key[length] != '/')
+			continue;
+		release(catalog, *(size_t *) mx_map_value_at(catalog->paths, i));
+	}
+}
+
+void catalog_sweep(catalog_t *catalog) {
+	for (size_t i = 0; i < mx_vector_length(catalog->records); i++) {
+		record_t *record = &catalog->records[i];
+		if (record->is_live && record->generation != catalog->generation)
+			release(catalog, i);
+	}
+	catalog->generation++;
+}
+
+static void print_ids(catalog_t *catalog, size_t *ids, FILE *out) {
+	for (size_t i = 0; i < mx_vector_length(ids); i++)
+		fprintf(out, i == 0 ? "%s" : ", %s", catalog->records[ids[i]].path);
+	fprintf(out, "\n");
+}
+
+/// A query for the set of a record and whether it has been printed
+typedef struct _query_t
+{
+	size_t id;
+	FILE *out;
+	bool is_printed;
+} query_t;
+
+static void print_set(void *data, catalog_t *catalog, size_t *ids) {
+	print_ids(catalog, ids, data);
+}
+
+static void print_queried_set(void *data, catalog_t *catalog, size_t *ids) {
+	query_t *query = data;
+	if (mx_vector_find(ids, id_eq, &query->id) == MX_ABSENT)
+		return;
+	print_ids(catalog, ids, query->out);
+	query->is_printed = true;
+}
+
+void catalog_print_set(catalog_t *catalog, size_t id, FILE *out) {
+	record_t *record = &catalog->records[id];
+	query_t query = { .id = id, .out = out, .is_printed = false };
+
+	if (record->is_hashed) {
+		group_key_t key = { .size = record->size, .digest = record->digest };
+		size_t *ids = *(size_t **) mx_map_get(catalog->groups, &key);
+		if (mx_vector_length(ids) >= 2)
+			confirm_group(catalog, ids, print_queried_set, &query);
+	}
+	if (!query.is_printed)
+		fprintf(out, "%s\n", record->path);
+}
+
+void catalog_print_sets(catalog_t *catalog, FILE *out) {
+	for (size_t i = 0; (i = mx_map_next(catalog->groups, i)) != MX_ABSENT; i++) {
+		size_t *ids = *(size_t **) mx_map_value_at(catalog->groups, i);
+		if (mx_vector_length(ids) >= 2)
+			confirm_group(catalog, ids, print_set, out);
+	}
+}
@@ -0,0 +1,113 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "mx/map.h"
+#include "mx/string.h"
+
+typedef struct _record_t
+{
+	mx_string_t path;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	uint64_t digest;
+	bool is_hashed;
+	bool is_live;
+	size_t generation; // the generation of the catalog when last updated
+} record_t;
+
+/**
+ * @brief An in-memory index of files by size and by digest
+ *
+ * A file is only hashed once another file of the same size is cataloged, so
+ * the cost of a file with a unique size is a single stat(). Files that share a
+ * size and a digest are in the same group; any group with two or more records
+ * is a duplicate set.
+ */
+typedef struct _catalog_t
+{
+	record_t *records; // records by id; ids of dead records are reused
+	size_t *free_ids;
+	mx_map_t paths;    // mx_string_t -> id
+	mx_map_t sizes;    // off_t -> mx_vector_t of ids
+	mx_map_t groups;   // group_key_t -> mx_vector_t of ids
+	bool is_deferred;  // whether hashing waits for catalog_flush()
+	size_t generation; // advanced by catalog_sweep()
+	const atomic_bool *is_cancelled; // stops catalog_flush() once set, if any
+} catalog_t;
+
+/// Receive the duplicate set @a ids of the @a catalog
+typedef void (*catalog_set_f)(void *data, catalog_t *catalog, size_t *ids);
+
+catalog_t *catalog_create(void);
+
+void catalog_delete(catalog_t *catalog);
+
+/**
+ * @brief Add or refresh the record for the file at @a path
+ *
+ * If the file is already cataloged and its inode, size and mtime are unchanged
+ * then this does nothing. Otherwise the file is rehashed as needed and moved to
+ * its new group. If @a path isn't a regular file anymore it is removed.
+ *
+ * @return the id of the record; otherwise MX_ABSENT
+ */
+size_t catalog_update(catalog_t *catalog, char *path);
+
+/**
+ * @brief Hash every record that is waiting to be hashed then stop deferring
+ *
+ * While @a catalog is deferred, catalog_update() only stats files. The records
+ * that need hashing are then hashed here in layout order (see layout_key()) so
+ * a rotational disk is read close to sequentially rather than in directory
+ * order.
+ */
+void catalog_flush(catalog_t *catalog);
+
+/**
+ * @brief Flush the @a catalog like catalog_flush() and pass every duplicate set
+ *        to @a set as soon as it is confirmed
+ *
+ * A set is ready once every record of its size is hashed, so sets whose size
+ * needs no hashing are passed first and the rest as their last record is
+ * hashed. The records of a group, which share a size and a digest, are then
+ * compared byte for byte and each class of two or more identical files is
+ * passed as a set. Hashing stops early if the flag at catalog->is_cancelled is set.
+ *
+ * @return whether the flush completed
+ */
+bool catalog_flush_sets(catalog_t *catalog, catalog_set_f set, void *data);
+
+/**
+ * @brief Remove every record not updated since the last sweep
+ *
+ * A caller rescanning the files of the @a catalog updates every file it finds
+ * then sweeps away the ones that are gone, without rehashing the rest.
+ */
+void catalog_sweep(catalog_t *catalog);
+
+/// Remove the record for the file at @a path if there is one
+void catalog_remove(catalog_t *catalog, char *path);
+
+/// Remove the records for @a path and every file beneath it
+void catalog_remove_tree(catalog_t *catalog, char *path);
+
+/// Return the id of the record for @a path; otherwise MX_ABSENT
+size_t catalog_find(catalog_t *catalog, char *path);
+
+/// Print the duplicates of the record @a id, compared byte for byte, as one
+/// line to @a out
+void catalog_print_set(catalog_t *catalog, size_t id, FILE *out);
+
+/// Print every duplicate set, compared byte for byte, one per line to @a out
+void catalog_print_sets(catalog_t *catalog, FILE *out);
+
+#endif /* CATALOG_H */
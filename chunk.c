@@ -0,0 +1,85 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mx/common.h"
+#include "mx/vector.h"
+#include "chunk.h"
+
+// the masks take the high bits of the gear hash, which depend on the last 64
+// bytes, two bits stricter and looser than log2(CHUNK_AVERAGE) = 13
+#define MASK_STRICT (~UINT64_C(0) << (64 - 15))
+#define MASK_LOOSE (~UINT64_C(0) << (64 - 11))
+
+static uint64_t gear[256];
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+/// Fill the gear table with splitmix64 so that chunking is deterministic
+static void init_gear(void) {
+	uint64_t state = 0;
+	for (size_t i = 0; i < 256; i++) {
+		uint64_t z = (state += UINT64_C(0x9e3779b97f4a7c15));
+		z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+		z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+		gear[i] = z ^ (z >> 31);
+	}
+}
+
+static void cut(chunker_t *chunker) {
+	chunk_t chunk = { .digest = chunker->digest, .length = chunker->length };
+	chunker->chunks = mx_vector_append(chunker->chunks, &chunk);
+	chunker->fingerprint = 0;
+	chunker->digest = MX_FNV1A_BASIS;
+	chunker->length = 0;
+}
+
+void chunker_init(chunker_t *chunker) {
+	pthread_once(&gear_once, init_gear);
+	chunker->fingerprint = 0;
+	chunker->digest = MX_FNV1A_BASIS;
+	chunker->length = 0;
+	chunker->chunks = mx_vector_create(sizeof(chunk_t));
+}
+
+void chunker_raze(chunker_t *chunker) {
+	mx_vector_delete(chunker->chunks);
+}
+
+void chunker_feed(chunker_t *chunker, const unsigned char *buffer, size_t size) {
+	static const unsigned char zeros[4096];
+
+	if (buffer == NULL) {
+		while (size > 0) {
+			size_t count = MX_MINIMUM(size, sizeof(zeros));
+			chunker_feed(chunker, zeros, count);
+			size -= count;
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < size; i++) {
+		unsigned char byte = buffer[i];
+		chunker->digest = (chunker->digest ^ byte) * UINT64_C(1099511628211);
+		chunker->length++;
+
+		// no boundary is looked for before the minimum so skip the gear hash
+		if (chunker->length < CHUNK_MINIMUM - 64)
+			continue;
+		chunker->fingerprint = (chunker->fingerprint << 1) + gear[byte];
+		if (chunker->length < CHUNK_MINIMUM)
+			continue;
+
+		uint64_t mask = chunker->length < CHUNK_AVERAGE ? MASK_STRICT : MASK_LOOSE;
+		if ((chunker->fingerprint & mask) == 0 || chunker->length >= CHUNK_MAXIMUM)
+			cut(chunker);
+	}
+}
+
+void chunker_finish(chunker_t *chunker) {
+	if (chunker->length > 0)
+		cut(chunker);
+}
+
+void chunker_sink(void *data, const unsigned char *buffer, size_t size) {
+	chunker_feed(data, buffer, size);
+}
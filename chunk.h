@@ -0,0 +1,48 @@
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHUNK_MINIMUM 2048
+#define CHUNK_AVERAGE 8192
+#define CHUNK_MAXIMUM 65536
+
+typedef struct _chunk_t
+{
+	uint64_t digest;
+	size_t length;
+} chunk_t;
+
+/**
+ * @brief A content-defined chunker (FastCDC)
+ *
+ * Boundaries are cut where a gear rolling hash over the last 64 bytes matches a
+ * mask, so an insertion only moves the boundaries near it and the chunks of the
+ * unchanged content still match. Normalized chunking uses a stricter mask below
+ * the average size and a looser one above it, which keeps chunk lengths close
+ * to CHUNK_AVERAGE between CHUNK_MINIMUM and CHUNK_MAXIMUM.
+ */
+typedef struct _chunker_t
+{
+	uint64_t fingerprint; // the gear hash
+	uint64_t digest;      // the FNV-1a hash of the current chunk
+	size_t length;        // the length of the current chunk
+	chunk_t *chunks;      // mx_vector_t of the chunks cut so far
+} chunker_t;
+
+void chunker_init(chunker_t *chunker);
+
+/// Raze the chunks of the @a chunker
+void chunker_raze(chunker_t *chunker);
+
+/// Feed @a size bytes at @a buffer to the @a chunker; NULL is @a size zeros
+void chunker_feed(chunker_t *chunker, const unsigned char *buffer, size_t size);
+
+/// Cut the last chunk if there is one left
+void chunker_finish(chunker_t *chunker);
+
+/// A reader_sink_f feeding a chunker_t
+void chunker_sink(void *data, const unsigned char *buffer, size_t size);
+
+#endif /* CHUNK_H */
@@ -0,0 +1,134 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "mx/map.h"
+#include "mx/string.h"
+#include "mx/vector.h"
+#include "contain.h"
+#include "manifest.h"
+#include "scan.h"
+
+/// The reference: a mapped manifest or scanned entries sorted by key
+typedef struct _index_t
+{
+	manifest_t *manifest;
+	manifest_entry_t *entries;
+} index_t;
+
+static size_t index_length(index_t *index) {
+	if (index->manifest != NULL)
+		return manifest_length(index->manifest);
+	return mx_vector_length(index->entries);
+}
+
+static const manifest_record_t *index_record(index_t *index, size_t i) {
+	if (index->manifest != NULL)
+		return manifest_record(index->manifest, i);
+	return &index->entries[i].record;
+}
+
+static const char *index_path(index_t *index, size_t i) {
+	if (index->manifest != NULL) {
+		const char *path = manifest_path(index->manifest, index_record(index, i));
+		return path == NULL ? "?" : path;
+	}
+	return index->entries[i].path;
+}
+
+/// Return the index of the first record not less than @a key
+static size_t index_search(index_t *index, const manifest_record_t *key) {
+	if (index->manifest != NULL)
+		return manifest_search(index->manifest, key);
+
+	size_t low = 0, high = index_length(index);
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		if (manifest_record_cmp(index_record(index, middle), key) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+/// Return whether the reference has a file of @a size
+static bool has_size(index_t *index, off_t size) {
+	manifest_record_t key = { .size = size, .partial = 0, .digest = 0 };
+	size_t i = index_search(index, &key);
+	return i < index_length(index) && index_record(index, i)->size == size;
+}
+
+/**
+ * Scan the @a references whose size is among the sizes of @a names; no other
+ * reference file can contain one of @a names so the rest are never read.
+ */
+static manifest_entry_t *scan_references(mx_string_t *names,
+		mx_string_t *references) {
+	mx_map_t sizes = mx_map_create(sizeof(off_t), sizeof(bool), NULL, NULL);
+	for (size_t i = 0; i < mx_vector_length(names); i++) {
+		struct stat st;
+		bool is_present = true;
+		if (stat(names[i], &st) == 0 && mx_map_put(sizes, &st.st_size, &is_present) == NULL)
+			abort();
+	}
+
+	manifest_entry_t *entries = mx_vector_create(sizeof(manifest_entry_t));
+	for (size_t i = 0; i < mx_vector_length(references); i++) {
+		struct stat st;
+		if (stat(references[i], &st) != 0 || mx_map_get(sizes, &st.st_size) == NULL)
+			continue;
+
+		manifest_entry_t entry = { .path = references[i] };
+		if (scan_file(references[i], &entry.record))
+			entries = mx_vector_append(entries, &entry);
+	}
+	mx_map_delete(sizes);
+
+	mx_vector_sort(entries, manifest_record_cmp);
+	return entries;
+}
+
+int contain_main(mx_string_t *names, mx_string_t *references, char *manifest) {
+	index_t index = { .manifest = NULL, .entries = NULL };
+	if (manifest != NULL) {
+		if ((index.manifest = manifest_open(manifest)) == NULL)
+			return 1;
+	} else
+		index.entries = scan_references(names, references);
+
+	size_t contained = 0;
+	for (size_t i = 0; i < mx_vector_length(names); i++) {
+		struct stat st;
+		if (stat(names[i], &st) != 0 || !S_ISREG(st.st_mode) ||
+				!has_size(&index, st.st_size))
+			continue;
+
+		manifest_record_t key;
+		if (!scan_file(names[i], &key))
+			continue;
+
+		size_t j = index_search(&index, &key);
+		if (j == index_length(&index) ||
+				manifest_record_cmp(index_record(&index, j), &key) != 0)
+			continue;
+
+		printf("%s", names[i]);
+		for (; j < index_length(&index) &&
+				manifest_record_cmp(index_record(&index, j), &key) == 0; j++)
+			printf(", %s", index_path(&index, j));
+		printf("\n");
+		contained++;
+	}
+
+	fprintf(stderr, "%zu of %zu files already in the reference\n", contained,
+		mx_vector_length(names));
+
+	if (index.manifest != NULL)
+		manifest_close(index.manifest);
+	else
+		mx_vector_delete(index.entries);
+	return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef CONTAIN_H
+#define CONTAIN_H
+
+#include "mx/string.h"
+
+/**
+ * @brief Report which of @a names the reference already contains
+ *
+ * The reference is either the files @a references, which are indexed by size
+ * and digest once, or the manifest at @a manifest, which is mapped and
+ * searched in place; the other is NULL. Each file of @a names is then looked
+ * up by size, and only read if the reference has a file of its size. Every
+ * contained file is printed as "name, reference, ...".
+ *
+ * @return the exit status
+ */
+int contain_main(mx_string_t *names, mx_string_t *references, char *manifest);
+
+#endif /* CONTAIN_H */
@@ -0,0 +1,184 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "mx/map.h"
+#include "device.h"
+
+#define ROTATIONAL_LIMIT 1
+#define NVME_LIMIT 8
+#define DEFAULT_LIMIT 4
+
+typedef struct _slots_t
+{
+	size_t limit;
+	size_t in_flight;
+	size_t node; // the NUMA node of the device or MX_ABSENT
+} slots_t;
+
+static mx_map_t devices; // dev_t -> slots_t
+static pthread_mutex_t devices_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t devices_cond = PTHREAD_COND_INITIALIZER;
+
+/// Return the limit for @a dev from whether sysfs says it is rotational or NVMe
+static size_t detect_limit(dev_t dev) {
+	char path[PATH_MAX], target[PATH_MAX];
+
+	// partitions keep their queue attributes on the parent device
+	char *formats[] = {
+		"/sys/dev/block/%u:%u/queue/rotational",
+		"/sys/dev/block/%u:%u/../queue/rotational",
+	};
+	for (size_t i = 0; i < sizeof(formats) / sizeof(*formats); i++) {
+		snprintf(path, sizeof(path), formats[i], major(dev), minor(dev));
+		FILE *file = fopen(path, "r");
+		if (file == NULL)
+			continue;
+		int rotational = 0;
+		int count = fscanf(file, "%d", &rotational);
+		fclose(file);
+		if (count == 1 && rotational)
+			return ROTATIONAL_LIMIT;
+		break;
+	}
+
+	snprintf(path, sizeof(path), "/sys/dev/block/%u:%u", major(dev), minor(dev));
+	ssize_t length = readlink(path, target, sizeof(target) - 1);
+	if (length > 0) {
+		target[length] = '\0';
+		char *name = strrchr(target, '/');
+		if (strncmp(name == NULL ? target : name + 1, "nvme", 4) == 0)
+			return NVME_LIMIT;
+	}
+
+	return DEFAULT_LIMIT;
+}
+
+/**
+ * Return the NUMA node of @a dev from sysfs. The node is on the bus device: the
+ * parent of a partition and, for NVMe, the controller of a namespace.
+ */
+static size_t detect_node(dev_t dev) {
+	char path[PATH_MAX];
+
+	char *formats[] = {
+		"/sys/dev/block/%u:%u/device/numa_node",
+		"/sys/dev/block/%u:%u/device/device/numa_node",
+		"/sys/dev/block/%u:%u/../device/numa_node",
+		"/sys/dev/block/%u:%u/../device/device/numa_node",
+	};
+	for (size_t i = 0; i < sizeof(formats) / sizeof(*formats); i++) {
+		snprintf(path, sizeof(path), formats[i], major(dev), minor(dev));
+		FILE *file = fopen(path, "r");
+		if (file == NULL)
+			continue;
+		int node = -1;
+		int count = fscanf(file, "%d", &node);
+		fclose(file);
+		if (count == 1 && node >= 0)
+			return node;
+	}
+
+	return MX_ABSENT;
+}
+
+/// Return the slots of @a dev creating them if need be; devices_mutex is held
+static slots_t *get_slots(dev_t dev) {
+	if (devices == NULL)
+		devices = mx_map_create(sizeof(dev_t), sizeof(slots_t), NULL, NULL);
+
+	slots_t *slots = mx_map_get(devices, &dev);
+	if (slots != NULL)
+		return slots;
+
+	slots_t created = {
+		.limit = detect_limit(dev),
+		.in_flight = 0,
+		.node = detect_node(dev),
+	};
+	if ((slots = mx_map_put(devices, &dev, &created)) == NULL)
+		abort();
+	return slots;
+}
+
+bool device_configure(char *spec) {
+	char *equals = strrchr(spec, '=');
+	if (equals == NULL)
+		return false;
+
+	char *end;
+	unsigned long limit = strtoul(equals + 1, &end, 10);
+	if (*end != '\0' || limit == 0)
+		return false;
+
+	*equals = '\0';
+	struct stat st;
+	int result = stat(spec, &st);
+	*equals = '=';
+	if (result != 0)
+		return false;
+
+	pthread_mutex_lock(&devices_mutex);
+	get_slots(st.st_dev)->limit = limit;
+	pthread_mutex_unlock(&devices_mutex);
+	return true;
+}
+
+size_t device_limit(dev_t dev) {
+	pthread_mutex_lock(&devices_mutex);
+	size_t limit = get_slots(dev)->limit;
+	pthread_mutex_unlock(&devices_mutex);
+	return limit;
+}
+
+size_t device_node(dev_t dev) {
+	pthread_mutex_lock(&devices_mutex);
+	size_t node = get_slots(dev)->node;
+	pthread_mutex_unlock(&devices_mutex);
+	return node;
+}
+
+/// Take the slots if both devices have one free; devices_mutex must be held
+static bool take_slots(dev_t dev_1, dev_t dev_2) {
+	slots_t *slots_1 = get_slots(dev_1);
+	bool result = slots_1->in_flight < slots_1->limit;
+	if (result && dev_2 != dev_1) {
+		slots_t *slots_2 = get_slots(dev_2);
+		// get_slots() may have moved the slots of dev_1
+		slots_1 = mx_map_get(devices, &dev_1);
+		result = slots_2->in_flight < slots_2->limit;
+		if (result)
+			slots_2->in_flight++;
+	}
+	if (result)
+		slots_1->in_flight++;
+	return result;
+}
+
+bool device_try_enter(dev_t dev_1, dev_t dev_2) {
+	pthread_mutex_lock(&devices_mutex);
+	bool result = take_slots(dev_1, dev_2);
+	pthread_mutex_unlock(&devices_mutex);
+	return result;
+}
+
+void device_enter(dev_t dev_1, dev_t dev_2) {
+	pthread_mutex_lock(&devices_mutex);
+	while (!take_slots(dev_1, dev_2))
+		pthread_cond_wait(&devices_cond, &devices_mutex);
+	pthread_mutex_unlock(&devices_mutex);
+}
+
+void device_leave(dev_t dev_1, dev_t dev_2) {
+	pthread_mutex_lock(&devices_mutex);
+	get_slots(dev_1)->in_flight--;
+	if (dev_2 != dev_1)
+		get_slots(dev_2)->in_flight--;
+	pthread_cond_broadcast(&devices_cond);
+	pthread_mutex_unlock(&devices_mutex);
+}
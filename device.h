@@ -0,0 +1,52 @@
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * @brief Configure the concurrency limit of a device from @a spec
+ *
+ * @a spec is PATH=LIMIT where PATH is any file on the device, such as its mount
+ * point, and LIMIT is the number of files read from it at once.
+ *
+ * @return whether @a spec was valid
+ */
+bool device_configure(char *spec);
+
+/**
+ * @brief Return the concurrency limit of the device @a dev
+ *
+ * Unless configured with device_configure() the limit is chosen from sysfs:
+ * rotational disks get 1, NVMe devices 8 and anything else 4.
+ */
+size_t device_limit(dev_t dev);
+
+/**
+ * @brief Return the NUMA node the device @a dev is attached to, from sysfs
+ *
+ * @return the node on success; otherwise MX_ABSENT, such as for devices
+ *         without a bus device or on machines without NUMA
+ */
+size_t device_node(dev_t dev);
+
+/**
+ * @brief Take a read slot on both @a dev_1 and @a dev_2 without blocking
+ *
+ * If @a dev_1 and @a dev_2 are the same device only one slot is taken.
+ *
+ * @return whether the slots were taken; if not then neither was
+ */
+bool device_try_enter(dev_t dev_1, dev_t dev_2);
+
+/// Take a read slot on both @a dev_1 and @a dev_2, waiting until both are free
+void device_enter(dev_t dev_1, dev_t dev_2);
+
+/**
+ * @brief Give back the read slots taken by device_try_enter(@a dev_1, @a dev_2)
+ *        or device_enter(@a dev_1, @a dev_2)
+ */
+void device_leave(dev_t dev_1, dev_t dev_2);
+
+#endif /* DEVICE_H */
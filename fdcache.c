@@ -0,0 +1,201 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "mx/common.h"
+#include "mx/map.h"
+#include "mx/vector.h"
+#include "fdcache.h"
+
+#define RESERVED_DESCRIPTORS 64
+
+typedef struct _entry_t
+{
+	size_t id;
+	int fd;
+	size_t refs;
+	size_t prev; // neighbors in the LRU list while unpinned
+	size_t next;
+} entry_t;
+
+struct _fdcache_t
+{
+	size_t volume;
+	int flags;
+	entry_t *entries; // mx_vector_t; slots of evicted entries are reused
+	size_t *free;     // mx_vector_t of free slots
+	mx_map_t slots;   // id -> slot in entries
+	size_t lru_head;  // most recently used unpinned entry
+	size_t lru_tail;  // least recently used unpinned entry
+	size_t length;    // open descriptors
+	size_t hits;
+	size_t misses;
+	pthread_mutex_t mutex;
+};
+
+static void lru_unlink(fdcache_t *cache, size_t slot) {
+	entry_t *entry = &cache->entries[slot];
+
+	if (entry->prev != MX_ABSENT)
+		cache->entries[entry->prev].next = entry->next;
+	else
+		cache->lru_head = entry->next;
+
+	if (entry->next != MX_ABSENT)
+		cache->entries[entry->next].prev = entry->prev;
+	else
+		cache->lru_tail = entry->prev;
+
+	entry->prev = entry->next = MX_ABSENT;
+}
+
+static void lru_push(fdcache_t *cache, size_t slot) {
+	entry_t *entry = &cache->entries[slot];
+
+	entry->prev = MX_ABSENT;
+	entry->next = cache->lru_head;
+	if (cache->lru_head != MX_ABSENT)
+		cache->entries[cache->lru_head].prev = slot;
+	else
+		cache->lru_tail = slot;
+	cache->lru_head = slot;
+}
+
+/// Close unpinned descriptors, least recently used first, down to the volume
+static void evict(fdcache_t *cache) {
+	while (cache->length > cache->volume && cache->lru_tail != MX_ABSENT) {
+		size_t slot = cache->lru_tail;
+		entry_t *entry = &cache->entries[slot];
+
+		lru_unlink(cache, slot);
+		close(entry->fd);
+		mx_map_remove(cache->slots, &entry->id);
+		cache->free = mx_vector_append(cache->free, &slot);
+		cache->length--;
+	}
+}
+
+fdcache_t *fdcache_create(size_t volume, int flags) {
+	fdcache_t *cache = malloc(sizeof(fdcache_t));
+	if (cache == NULL)
+		return NULL;
+
+	if (volume == 0) {
+		// raising the limit is left to the program, which owns it
+		struct rlimit limit;
+		if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY)
+			limit.rlim_cur = 1024;
+
+		if (limit.rlim_cur > 2 * RESERVED_DESCRIPTORS)
+			volume = limit.rlim_cur - RESERVED_DESCRIPTORS;
+		else
+			volume = limit.rlim_cur / 2;
+	}
+
+	cache->volume = MX_MAXIMUM(volume, (size_t) 1);
+	cache->flags = flags;
+	cache->entries = mx_vector_create(sizeof(entry_t));
+	cache->free = mx_vector_create(sizeof(size_t));
+	cache->slots = mx_map_create(sizeof(size_t), sizeof(size_t), NULL, NULL);
+	cache->lru_head = cache->lru_tail = MX_ABSENT;
+	cache->length = 0;
+	cache->hits = cache->misses = 0;
+	pthread_mutex_init(&cache->mutex, NULL);
+
+	return cache;
+}
+
+void fdcache_delete(fdcache_t *cache) {
+	for (size_t i = 0; (i = mx_map_next(cache->slots, i)) != MX_ABSENT; i++) {
+		size_t slot = *(size_t *) mx_map_value_at(cache->slots, i);
+		close(cache->entries[slot].fd);
+	}
+
+	mx_map_delete(cache->slots);
+	mx_vector_delete(cache->free);
+	mx_vector_delete(cache->entries);
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache);
+}
+
+int fdcache_acquire(fdcache_t *cache, size_t id, char *name) {
+	pthread_mutex_lock(&cache->mutex);
+	size_t *slot = mx_map_get(cache->slots, &id);
+	if (slot != NULL) {
+		entry_t *entry = &cache->entries[*slot];
+		if (entry->refs++ == 0)
+			lru_unlink(cache, *slot);
+		cache->hits++;
+		int fd = entry->fd;
+		pthread_mutex_unlock(&cache->mutex);
+		return fd;
+	}
+	cache->misses++;
+	pthread_mutex_unlock(&cache->mutex);
+
+	// open outside of the lock so that a slow open doesn't stall other workers
+	int fd = open(name, O_RDONLY | O_CLOEXEC | cache->flags);
+	if (fd < 0 && cache->flags != 0)
+		fd = open(name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	pthread_mutex_lock(&cache->mutex);
+
+	// another worker may have opened the same file in the meantime
+	if ((slot = mx_map_get(cache->slots, &id)) != NULL) {
+		entry_t *entry = &cache->entries[*slot];
+		if (entry->refs++ == 0)
+			lru_unlink(cache, *slot);
+		int cached = entry->fd;
+		pthread_mutex_unlock(&cache->mutex);
+		close(fd);
+		return cached;
+	}
+
+	entry_t entry = {
+		.id = id, .fd = fd, .refs = 1, .prev = MX_ABSENT, .next = MX_ABSENT,
+	};
+	size_t free_slot;
+	if (mx_vector_length(cache->free) > 0) {
+		cache->free = mx_vector_pull(cache->free, &free_slot);
+		cache->entries[free_slot] = entry;
+	} else {
+		free_slot = mx_vector_length(cache->entries);
+		cache->entries = mx_vector_append(cache->entries, &entry);
+	}
+	if (mx_map_put(cache->slots, &id, &free_slot) == NULL)
+		abort();
+	cache->length++;
+
+	evict(cache);
+	pthread_mutex_unlock(&cache->mutex);
+	return fd;
+}
+
+void fdcache_release(fdcache_t *cache, size_t id) {
+	pthread_mutex_lock(&cache->mutex);
+	size_t *slot = mx_map_get(cache->slots, &id);
+	if (slot != NULL && --cache->entries[*slot].refs == 0) {
+		lru_push(cache, *slot);
+		evict(cache);
+	}
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+size_t fdcache_hits(fdcache_t *cache) {
+	pthread_mutex_lock(&cache->mutex);
+	size_t hits = cache->hits;
+	pthread_mutex_unlock(&cache->mutex);
+	return hits;
+}
+
+size_t fdcache_misses(fdcache_t *cache) {
+	pthread_mutex_lock(&cache->mutex);
+	size_t misses = cache->misses;
+	pthread_mutex_unlock(&cache->mutex);
+	return misses;
+}
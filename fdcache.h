@@ -0,0 +1,46 @@
+#ifndef FDCACHE_H
+#define FDCACHE_H
+
+#include <stddef.h>
+
+typedef struct _fdcache_t fdcache_t;
+
+/**
+ * @brief Allocate and initialize a cache of at most @a volume open descriptors
+ *
+ * If @a volume is zero it is derived from the current soft RLIMIT_NOFILE, which
+ * is left as it is: all but 64 descriptors of it are used, leaving room for
+ * descriptors pinned past the volume and for everything else.
+ *
+ * Files are opened read only with @a flags added; if that fails they are opened
+ * read only.
+ *
+ * @return the cache on success; otherwise NULL
+ */
+fdcache_t *fdcache_create(size_t volume, int flags);
+
+/// Close every descriptor in the @a cache and deallocate it
+void fdcache_delete(fdcache_t *cache);
+
+/**
+ * @brief Return an open descriptor for the file @a id at @a name and pin it
+ *
+ * A pinned descriptor isn't evicted until each fdcache_acquire() of it is
+ * matched by an fdcache_release(). Unpinned descriptors are evicted least
+ * recently used first once the cache holds more than its volume. Reads through
+ * a shared descriptor must use explicit offsets such as pread().
+ *
+ * @return the descriptor on success; otherwise -1 with errno set
+ */
+int fdcache_acquire(fdcache_t *cache, size_t id, char *name);
+
+/// Unpin the descriptor of the file @a id
+void fdcache_release(fdcache_t *cache, size_t id);
+
+/// Return the number of acquisitions that found the descriptor already open
+size_t fdcache_hits(fdcache_t *cache);
+
+/// Return the number of acquisitions that had to open the file
+size_t fdcache_misses(fdcache_t *cache);
+
+#endif /* FDCACHE_H */
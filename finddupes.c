@@ -0,0 +1,140 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mx/string.h"
+#include "mx/vector.h"
+#include "catalog.h"
+#include "finddupes.h"
+#include "reader.h"
+#include "walk.h"
+
+struct _finddupes_t
+{
+	mx_string_t *roots;
+	catalog_t *catalog;
+	atomic_bool is_cancelled;
+};
+
+/// The callback of a scan and the paths of the set being passed to it
+typedef struct _scan_t
+{
+	finddupes_set_f set;
+	void *data;
+	const char **paths;
+} scan_t;
+
+finddupes_t *finddupes_create(const finddupes_options_t *options) {
+	finddupes_t *engine = malloc(sizeof(finddupes_t));
+	if (engine == NULL)
+		return NULL;
+
+	if ((engine->catalog = catalog_create()) == NULL) {
+		free(engine);
+		return NULL;
+	}
+	engine->roots = mx_vector_create(sizeof(mx_string_t));
+	atomic_init(&engine->is_cancelled, false);
+	engine->catalog->is_cancelled = &engine->is_cancelled;
+
+	if (options != NULL) {
+		reader_config.is_direct = options->is_direct;
+		if (options->buffer_size != 0)
+			reader_config.buffer_size = options->buffer_size;
+		reader_config.cache_pages = options->cache_pages;
+	}
+
+	return engine;
+}
+
+void finddupes_delete(finddupes_t *engine) {
+	finddupes_clear_roots(engine);
+	mx_vector_delete(engine->roots);
+	catalog_delete(engine->catalog);
+	free(engine);
+}
+
+bool finddupes_add_root(finddupes_t *engine, const char *root) {
+	mx_string_t path = mx_string_create((char *) root, 0);
+	if (path == NULL)
+		return false;
+
+	mx_string_t *roots = mx_vector_append(engine->roots, &path);
+	if (roots == NULL) {
+		mx_string_delete(path);
+		return false;
+	}
+	engine->roots = roots;
+	return true;
+}
+
+void finddupes_clear_roots(finddupes_t *engine) {
+	for (size_t i = 0; i < mx_vector_length(engine->roots); i++)
+		mx_string_delete(engine->roots[i]);
+	engine->roots = mx_vector_truncate(engine->roots, 0);
+}
+
+void finddupes_cancel(finddupes_t *engine) {
+	atomic_store(&engine->is_cancelled, true);
+}
+
+/// Walk the directory @a path unless the scan is cancelled
+static bool enter_directory(void *data, const char *path) {
+	(void) path;
+	finddupes_t *engine = data;
+	return !atomic_load(&engine->is_cancelled);
+}
+
+/// Catalog the file @a path and go on unless the scan is cancelled
+static bool catalog_file(void *data, const char *path) {
+	finddupes_t *engine = data;
+	if (atomic_load(&engine->is_cancelled))
+		return false;
+	catalog_update(engine->catalog, (char *) path);
+	return true;
+}
+
+static void pass_set(void *data, catalog_t *catalog, size_t *ids) {
+	scan_t *scan = data;
+
+	size_t length = mx_vector_length(ids);
+	scan->paths = realloc(scan->paths, length * sizeof(char *));
+	if (scan->paths == NULL)
+		abort();
+	for (size_t i = 0; i < length; i++)
+		scan->paths[i] = catalog->records[ids[i]].path;
+
+	scan->set(scan->data, scan->paths, length);
+}
+
+finddupes_status_t finddupes_scan(finddupes_t *engine, finddupes_set_f set,
+		void *data) {
+	atomic_store(&engine->is_cancelled, false);
+
+	catalog_t *catalog = engine->catalog;
+	catalog->is_deferred = true;
+
+	bool is_walked = true;
+	for (size_t i = 0; i < mx_vector_length(engine->roots); i++)
+		is_walked &= walk_tree(engine->roots[i], enter_directory, catalog_file,
+			engine);
+
+	if (atomic_load(&engine->is_cancelled)) {
+		catalog->is_deferred = false;
+		return FINDDUPES_CANCELLED;
+	}
+
+	// files under a root that failed to walk are kept rather than forgotten
+	if (is_walked)
+		catalog_sweep(catalog);
+
+	scan_t scan = { .set = set, .data = data, .paths = NULL };
+	bool is_flushed = catalog_flush_sets(catalog,
+		set == NULL ? NULL : pass_set, &scan);
+	free(scan.paths);
+
+	if (!is_flushed)
+		return FINDDUPES_CANCELLED;
+	return is_walked ? FINDDUPES_DONE : FINDDUPES_FAILED;
+}
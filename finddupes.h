@@ -0,0 +1,79 @@
+#ifndef FINDDUPES_H
+#define FINDDUPES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @file
+ * @brief The duplicate finding engine as a library (libfinddupes)
+ *
+ * An engine holds a set of roots and a catalog of the files beneath them. A
+ * scan walks the roots, hashes the files that share a size and passes each
+ * duplicate set to a callback as soon as its files are compared byte for
+ * byte. The catalog is kept
+ * between scans, so rescanning an engine only rehashes the files that changed.
+ *
+ * An engine isn't thread safe, except for finddupes_cancel().
+ */
+
+typedef struct _finddupes_t finddupes_t;
+
+typedef enum _finddupes_status_t
+{
+	FINDDUPES_DONE,
+	FINDDUPES_CANCELLED,
+	FINDDUPES_FAILED, // a root couldn't be walked; the other roots were
+} finddupes_status_t;
+
+typedef struct _finddupes_options_t
+{
+	bool is_direct;      // read with O_DIRECT
+	size_t buffer_size;  // read this many bytes at a time, or zero for 64 KiB
+	size_t cache_pages;  // cap the page cache pages kept alive, or zero
+} finddupes_options_t;
+
+/**
+ * @brief Receive the duplicate set of the @a length files at @a paths
+ *
+ * The paths are only valid during the call. finddupes_cancel() may be called
+ * from here.
+ */
+typedef void (*finddupes_set_f)(void *data, const char **paths, size_t length);
+
+/**
+ * @brief Allocate and initialize an engine
+ *
+ * The options are process wide and only apply if no file has been read yet by
+ * any engine; @a options may be NULL for the defaults.
+ *
+ * @return the engine on success; otherwise NULL
+ */
+finddupes_t *finddupes_create(const finddupes_options_t *options);
+
+/// Raze and deallocate the @a engine
+void finddupes_delete(finddupes_t *engine);
+
+/// Add the directory at @a root to the roots of the @a engine
+bool finddupes_add_root(finddupes_t *engine, const char *root);
+
+/// Remove every root of the @a engine; their files are forgotten at the next scan
+void finddupes_clear_roots(finddupes_t *engine);
+
+/**
+ * @brief Scan the roots of the @a engine and pass every duplicate set to @a set
+ *
+ * Files are walked recursively, stat()ed and only hashed if another file has
+ * their size. Files that are unchanged since the last scan aren't hashed again
+ * and files that are gone are forgotten.
+ *
+ * @return FINDDUPES_CANCELLED if finddupes_cancel() stopped the scan, which
+ *         may have passed some sets already
+ */
+finddupes_status_t finddupes_scan(finddupes_t *engine, finddupes_set_f set,
+	void *data);
+
+/// Stop the scan in progress on the @a engine as soon as possible
+void finddupes_cancel(finddupes_t *engine);
+
+#endif /* FINDDUPES_H */
@@ -0,0 +1,82 @@
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mx/string.h"
+#include "mx/vector.h"
+#include "layout.h"
+
+typedef struct _keyed_path_t
+{
+	layout_key_t key;
+	mx_string_t path;
+} keyed_path_t;
+
+layout_key_t layout_key(char *path) {
+	layout_key_t key = { 0 };
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return key;
+
+	struct stat st;
+	if (fstat(fd, &st) == 0) {
+		key.dev = st.st_dev;
+		key.is_inode = 1;
+		key.offset = st.st_ino;
+	}
+
+	// only the first extent is needed; FIEMAP_FLAG_SYNC is deliberately not set
+	// so that dirty files aren't flushed just to be ordered
+	struct {
+		struct fiemap fiemap;
+		struct fiemap_extent extent;
+	} request;
+	memset(&request, 0, sizeof(request));
+	request.fiemap.fm_length = FIEMAP_MAX_OFFSET;
+	request.fiemap.fm_extent_count = 1;
+
+	if (ioctl(fd, FS_IOC_FIEMAP, &request.fiemap) == 0 &&
+			request.fiemap.fm_mapped_extents > 0 &&
+			!(request.extent.fe_flags & FIEMAP_EXTENT_UNKNOWN)) {
+		key.is_inode = 0;
+		key.offset = request.extent.fe_physical;
+	}
+
+	close(fd);
+	return key;
+}
+
+int layout_cmp(const void *a, const void *b) {
+	const layout_key_t *key_a = a, *key_b = b;
+
+	if (key_a->dev != key_b->dev)
+		return key_a->dev < key_b->dev ? -1 : 1;
+	if (key_a->is_inode != key_b->is_inode)
+		return key_a->is_inode - key_b->is_inode;
+	if (key_a->offset != key_b->offset)
+		return key_a->offset < key_b->offset ? -1 : 1;
+	return 0;
+}
+
+void layout_sort(mx_string_t *paths) {
+	size_t length = mx_vector_length(paths);
+	keyed_path_t *keyed = mx_vector_create_with(sizeof(keyed_path_t), length);
+	if (keyed == NULL)
+		return;
+
+	for (size_t i = 0; i < length; i++)
+		keyed[i] = (keyed_path_t) { .key = layout_key(paths[i]), .path = paths[i] };
+
+	// the key is the first member so layout_cmp() orders keyed paths as well
+	mx_vector_sort(keyed, layout_cmp);
+
+	for (size_t i = 0; i < length; i++)
+		paths[i] = keyed[i].path;
+	mx_vector_delete(keyed);
+}
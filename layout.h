@@ -0,0 +1,33 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "mx/string.h"
+
+/**
+ * @brief Where a file's content starts on disk
+ *
+ * Keys order files by device, then by the physical offset of their first
+ * extent (from FIEMAP) where the filesystem reports one, then by inode number
+ * for the rest. Reading files in key order walks a rotational disk close to
+ * sequentially.
+ */
+typedef struct _layout_key_t
+{
+	dev_t dev;
+	int is_inode; // whether offset is an inode number rather than a location
+	uint64_t offset;
+} layout_key_t;
+
+/// Return the layout key of the file at @a path (an all zero key on failure)
+layout_key_t layout_key(char *path);
+
+/// Compare the layout keys at @a a and @a b
+int layout_cmp(const void *a, const void *b);
+
+/// Sort the vector of @a paths into layout key order
+void layout_sort(mx_string_t *paths);
+
+#endif /* LAYOUT_H */
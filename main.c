@@ -1,111 +1,214 @@
 #include <errno.h>
 #include <stdbool.h>
-#include <dirent.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "mx/common.h"
 #include "mx/string.h"
 #include "mx/vector.h"
-
-FILE *open_file(char *name, char *mode) {
-	FILE *file = fopen(name, mode);
-	if (file != NULL)
-		return file;
-	fprintf(stderr, "fopen() failed on %s: %s\n", name, strerror(errno));
-	exit(1);
-}
-
-bool is_same_file(char *name_1, char *name_2) {
-	FILE *file_1 = open_file(name_1, "r");
-	FILE *file_2 = open_file(name_2, "r");
-	unsigned char buffer_1[2048], buffer_2[2048];
-
-	do {
-		size_t size_1 = fread(buffer_1, 1, 2048, file_1);
-		size_t size_2 = fread(buffer_2, 1, 2048, file_2);
-		if (size_1 != size_2 || memcmp(buffer_1, buffer_2, size_1) != 0) {
-			fclose(file_1);
-			fclose(file_2);
-			return false;
-		}
-	} while (!feof(file_1) || !feof(file_2));
-
-	bool result = feof(file_1) == feof(file_2);
-	fclose(file_1);
-	fclose(file_2);
-	return result;
-}
-
-typedef struct _pair_t
+#include "affinity.h"
+#include "async.h"
+#include "contain.h"
+#include "device.h"
+#include "layout.h"
+#include "partial.h"
+#include "pipeline.h"
+#include "reader.h"
+#include "scan.h"
+#include "similar.h"
+#include "walk.h"
+#include "watch.h"
+
+/**
+ * A block of the upper triangle of the matrix of pairs: names[i] is compared
+ * with names[j] for every i in [i_begin, i_end) and j in [j_begin, j_end) with
+ * i < j. Tiles never straddle devices so every pair of a tile reads from dev_1
+ * and dev_2.
+ */
+typedef struct _tile_t
 {
 	bool is_done;
-	mx_string_t name_1;
-	mx_string_t name_2;
-} pair_t;
-
-pair_t *queue;
-size_t queue_head = 0;
+	size_t i_begin, i_end;
+	size_t j_begin, j_end;
+	dev_t dev_1;
+	dev_t dev_2;
+} tile_t;
+
+/// The queue of tiles that read from the same device or pair of devices
+typedef struct _lane_t
+{
+	dev_t dev_1;
+	dev_t dev_2;
+	size_t node; // the NUMA node of dev_1 or MX_ABSENT
+	tile_t *tiles;
+	size_t head;
+} lane_t;
+
+mx_string_t *names;
+dev_t *devs;
+size_t tile_size = 64;
+
+/// Whether workers are pinned to CPUs and take the lanes of their own node
+bool is_placed = false;
+
+/// The number of workers comparing tiles, or zero to choose it from the files
+size_t workers_count = 0;
+
+lane_t *lanes;
+size_t lanes_cursor = 0;
+size_t done_count = 0;
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
 
+/// The bytes of queued tiles allowed before enqueue_tile() blocks
+size_t queue_budget = 16 << 20;
+size_t queue_bytes = 0;
+pthread_cond_t space_cond = PTHREAD_COND_INITIALIZER;
+
 pthread_mutex_t results_mutex = PTHREAD_MUTEX_INITIALIZER;
 size_t results_count = 0;
 pthread_cond_t results_cond = PTHREAD_COND_INITIALIZER;
 
-void enqueue_pair(pair_t *p) {
+void enqueue_tile(tile_t *t) {
 	if (pthread_mutex_lock(&mutex) != 0)
 		abort();
 
-	queue = mx_vector_append(queue, p);
+	if (t->is_done)
+		done_count++;
+	else {
+		// block the producer until the workers free up room in the budget; a
+		// budget smaller than a tile still lets one tile through at a time
+		while (queue_bytes > 0 && queue_bytes + sizeof(tile_t) > queue_budget)
+			pthread_cond_wait(&space_cond, &mutex);
+		queue_bytes += sizeof(tile_t);
+
+		dev_t dev_1 = MX_MINIMUM(t->dev_1, t->dev_2);
+		dev_t dev_2 = MX_MAXIMUM(t->dev_1, t->dev_2);
+
+		size_t i = 0;
+		while (i < mx_vector_length(lanes) &&
+				(lanes[i].dev_1 != dev_1 || lanes[i].dev_2 != dev_2))
+			i++;
+		if (i == mx_vector_length(lanes)) {
+			lane_t lane = {
+				.dev_1 = dev_1, .dev_2 = dev_2,
+				.node = device_node(dev_1),
+				.head = 0,
+			};
+			lane.tiles = mx_vector_create(sizeof(tile_t));
+			lanes = mx_vector_append(lanes, &lane);
+		}
 
-	if (mx_vector_length(queue) == 1)
-		pthread_cond_signal(&cond);
+		lanes[i].tiles = mx_vector_append(lanes[i].tiles, t);
+	}
+
+	pthread_cond_broadcast(&cond);
 
 	pthread_mutex_unlock(&mutex);
 }
 
-void dequeue_pair(pair_t *p) {
+/**
+ * Take the next tile from a lane whose devices have a free read slot, visiting
+ * lanes round robin so that a slow device can't starve the others. A done
+ * marker is only handed out once every lane is drained.
+ *
+ * A placed worker takes tiles from the lanes of devices on its own NUMA node
+ * (or on no known node) and only helps with the lanes of other nodes once its
+ * own are drained.
+ */
+void dequeue_tile(tile_t *t) {
+	size_t node = is_placed ? affinity_node() : MX_ABSENT;
+
 	if (pthread_mutex_lock(&mutex) != 0)
 		abort();
 
-	if (mx_vector_length(queue) == 0)
+	while (true) {
+		size_t lanes_length = mx_vector_length(lanes);
+		bool is_drained = true;
+		bool is_local_drained = true;
+
+		for (size_t pass = 0; pass < 2 && (pass == 0 || is_local_drained); pass++) {
+			for (size_t k = 0; k < lanes_length; k++) {
+				size_t i = (lanes_cursor + k) % lanes_length;
+				lane_t *lane = &lanes[i];
+				if (lane->head == mx_vector_length(lane->tiles))
+					continue;
+				is_drained = false;
+				if (pass == 0 && node != MX_ABSENT && lane->node != MX_ABSENT &&
+						lane->node != node)
+					continue;
+				is_local_drained = false;
+				if (!device_try_enter(lane->dev_1, lane->dev_2))
+					continue;
+
+				*t = lane->tiles[lane->head];
+				lane->head++;
+				lanes_cursor = (i + 1) % lanes_length;
+
+				// drop the consumed tiles once they are most of the lane
+				if (lane->head > mx_vector_length(lane->tiles) / 2) {
+					lane->tiles = mx_vector_excise(lane->tiles, 0, lane->head);
+					lane->head = 0;
+				}
+
+				queue_bytes -= sizeof(tile_t);
+				pthread_cond_signal(&space_cond);
+				pthread_mutex_unlock(&mutex);
+				return;
+			}
+		}
+
+		if (is_drained && done_count > 0) {
+			done_count--;
+			pthread_mutex_unlock(&mutex);
+			t->is_done = true;
+			return;
+		}
+
 		pthread_cond_wait(&cond, &mutex);
+	}
+}
+
+/// Give back the read slots taken for @a t by dequeue_tile()
+void finish_tile(tile_t *t) {
+	device_leave(t->dev_1, t->dev_2);
 
-	pair_t dequeued = queue[queue_head];
-	queue_head++;
+	pthread_mutex_lock(&mutex);
+	pthread_cond_broadcast(&cond);
 	pthread_mutex_unlock(&mutex);
-	*p = dequeued;
 }
 
 void *thread_main(void *data)
 {
+	// the worker's read buffers are placed on its node as it first fills them
+	if (is_placed)
+		affinity_pin((size_t) data);
+
 	while (true) {
-		pair_t p;
-		dequeue_pair(&p);
-		if (p.is_done)
+		tile_t t;
+		dequeue_tile(&t);
+		if (t.is_done)
 			return NULL;
 
-		if (strcmp(p.name_1, p.name_2) == 0) {
-			pthread_mutex_lock(&results_mutex);
-			results_count++;
-			pthread_cond_signal(&results_cond);
-			pthread_mutex_unlock(&results_mutex);
-			continue;
-		}
-		if (!is_same_file(p.name_1, p.name_2)) {
-			pthread_mutex_lock(&results_mutex);
-			results_count++;
-			pthread_cond_signal(&results_cond);
-			pthread_mutex_unlock(&results_mutex);
-			continue;
+		// generate the pairs of the tile row by row so that only the files of
+		// one row and the tile's columns are touched
+		size_t count = 0;
+		for (size_t i = t.i_begin; i < t.i_end; i++) {
+			for (size_t j = MX_MAXIMUM(t.j_begin, i + 1); j < t.j_end; j++) {
+				if (is_same_file_id(i, names[i], j, names[j]))
+					printf("%s, %s\n", names[i], names[j]);
+				count++;
+			}
 		}
-
-		printf("%s, %s\n", p.name_1, p.name_2);
+		finish_tile(&t);
 
 		pthread_mutex_lock(&results_mutex);
-		results_count++;
+		results_count += count;
 		pthread_cond_signal(&results_cond);
 		pthread_mutex_unlock(&results_mutex);
 	}
@@ -113,67 +216,319 @@ void *thread_main(void *data)
 	return NULL;
 }
 
-int main(int argc, char **argv)
+/// The files listed so far and, unless recursive, the root being listed
+typedef struct _listing_t
 {
-	DIR *dirp = opendir("random_data");
+	mx_string_t *names;
+	const char *root;
+} listing_t;
 
-	mx_string_t *names = mx_vector_create(sizeof(mx_string_t));
+static bool enter_directory(void *data, const char *path) {
+	listing_t *listing = data;
+	return listing->root == NULL || strcmp(path, listing->root) == 0;
+}
+
+static bool append_file(void *data, const char *path) {
+	listing_t *listing = data;
+	mx_string_t name = mx_string_create((char *) path, 0);
+	listing->names = mx_vector_append(listing->names, &name);
+	return true;
+}
 
-	struct dirent *dirent;
-	while ((dirent = readdir(dirp)) != NULL) {
-		if (dirent->d_type != DT_REG)
-			continue;
-		mx_string_t name_1 = mx_string_create(NULL, 0);
-		name_1 = mx_string_catf(name_1, "random_data/%s", dirent->d_name);
-		names = mx_vector_append(names, &name_1);
+/// List the files of @a roots, and of every directory beneath them if
+/// @a is_recursive, in on-disk order
+mx_string_t *list_files(char **roots, size_t roots_length, bool is_recursive) {
+	listing_t listing = { .names = mx_vector_create(sizeof(mx_string_t)) };
+
+	for (size_t i = 0; i < roots_length; i++) {
+		listing.root = is_recursive ? NULL : roots[i];
+		if (!walk_tree(roots[i], enter_directory, append_file, &listing))
+			exit(1);
 	}
-	closedir(dirp);
 
-	size_t names_length = mx_vector_length(names);
+	// compare in on-disk order so that a rotational disk seeks less
+	layout_sort(listing.names);
+	return listing.names;
+}
+
+/**
+ * Return the number of workers for the files of devs: one per online CPU, but
+ * no more than the devices let read at once since the rest would only wait
+ */
+size_t choose_workers_count(void) {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t slots = 0;
+	// layout_sort() put the files of a device next to each other
+	for (size_t i = 0; i < mx_vector_length(devs); i++) {
+		if (i == 0 || devs[i] != devs[i - 1])
+			slots += device_limit(devs[i]);
+	}
+	return MX_MAXIMUM(MX_MINIMUM((size_t) MX_MAXIMUM(cpus, 1L), slots), (size_t) 1);
+}
+
+/// Raise the soft limit of open files to the hard limit for the descriptor cache
+void raise_file_limit(void) {
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+		return;
+	limit.rlim_cur = limit.rlim_max;
+	if (setrlimit(RLIMIT_NOFILE, &limit) != 0)
+		fprintf(stderr, "setrlimit() failed: %s\n", strerror(errno));
+}
+
+void usage(char *program) {
+	fprintf(stderr, "usage: %s [-DFHLNpsw] [-A files] [-B MiB] [-b KiB] [-C threads] "
+		"[-c pages] [-f files] [-j similarity] [-K KiB] [-k blocks] [-l path=limit] "
+		"[-m MiB] [-o manifest] [-P stat,partial,full] [-r reference] [-T MiB] "
+		"[-t files] [-V trust|verify|weak] [-W workers] [root ...]\n", program);
+	fprintf(stderr, "  -D  read with O_DIRECT to bypass the page cache\n");
+	fprintf(stderr, "  -A  hash from one thread with this many files in flight\n");
+	fprintf(stderr, "  -B  share this many MiB of file blocks between compares\n");
+	fprintf(stderr, "  -b  read each file this many KiB at a time\n");
+	fprintf(stderr, "  -C  compare each pair of large files with this many threads\n");
+	fprintf(stderr, "  -c  cap the page cache pages each worker keeps alive\n");
+	fprintf(stderr, "  -F  raise the open file limit to the hard limit first\n");
+	fprintf(stderr, "  -f  keep at most this many files open between compares\n");
+	fprintf(stderr, "  -H  hash with SHA-256 in the pipeline\n");
+	fprintf(stderr, "  -j  report pairs of files at least this similar (0 to 1)\n");
+	fprintf(stderr, "  -K  sample blocks of this many KiB\n");
+	fprintf(stderr, "  -k  sample this many blocks of large files before comparing them\n");
+	fprintf(stderr, "  -L  carve read buffers from 2 MiB huge pages (experimental)\n");
+	fprintf(stderr, "  -l  read at most limit files at once from the device of path\n");
+	fprintf(stderr, "  -m  cap the memory of queued tiles at this many MiB\n");
+	fprintf(stderr, "  -N  pin workers to CPUs and give them the devices of their node\n");
+	fprintf(stderr, "  -o  write the manifest of the roots for merge to this file\n");
+	fprintf(stderr, "  -P  run the pipeline with these threads for stat and hashing\n");
+	fprintf(stderr, "  -p  report pairs of files sharing content-defined chunks\n");
+	fprintf(stderr, "  -r  report the files already in this directory or manifest\n");
+	fprintf(stderr, "  -s  print cache and sampling statistics to stderr when done\n");
+	fprintf(stderr, "  -T  hash larger files of the pipeline in ranges of this many MiB\n");
+	fprintf(stderr, "  -t  compare files in tiles of this many by this many\n");
+	fprintf(stderr, "  -V  verify the pipeline's sets never, always or with a weak hash\n");
+	fprintf(stderr, "  -W  compare tiles with this many workers\n");
+	fprintf(stderr, "  -w  catalog the roots then watch them for changes\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	bool is_watch = false;
+	bool is_stats = false;
+	bool is_partial = false;
+	bool is_pipeline = false;
+	bool is_similar = false;
+	double threshold = 0;
+	char *manifest = NULL;
+	char *reference = NULL;
+	size_t in_flight = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "DA:B:b:C:c:Ff:Hj:K:k:Ll:m:No:P:pr:sT:t:V:W:w")) != -1) {
+		switch (opt) {
+		case 'D':
+			reader_config.is_direct = true;
+			break;
+		case 'A':
+			in_flight = strtoul(optarg, NULL, 10);
+			break;
+		case 'B':
+			reader_config.block_cache_size = strtoul(optarg, NULL, 10) << 20;
+			break;
+		case 'b':
+			reader_config.buffer_size = strtoul(optarg, NULL, 10) * 1024;
+			break;
+		case 'C':
+			reader_config.range_threads = strtoul(optarg, NULL, 10);
+			break;
+		case 'c':
+			reader_config.cache_pages = strtoul(optarg, NULL, 10);
+			break;
+		case 'F':
+			raise_file_limit();
+			break;
+		case 'f':
+			reader_config.fd_cache_size = strtoul(optarg, NULL, 10);
+			break;
+		case 'H':
+			pipeline_config.is_strong = true;
+			break;
+		case 'j':
+			is_similar = true;
+			threshold = strtod(optarg, NULL);
+			break;
+		case 'K':
+			reader_config.sample_size = strtoul(optarg, NULL, 10) * 1024;
+			break;
+		case 'k':
+			reader_config.sample_count = strtoul(optarg, NULL, 10);
+			break;
+		case 'L':
+			reader_config.is_huge = true;
+			break;
+		case 'l':
+			if (!device_configure(optarg)) {
+				fprintf(stderr, "invalid device limit: %s\n", optarg);
+				usage(argv[0]);
+			}
+			break;
+		case 'm':
+			queue_budget = strtoul(optarg, NULL, 10) << 20;
+			break;
+		case 'N':
+			is_placed = true;
+			break;
+		case 'o':
+			manifest = optarg;
+			break;
+		case 'P':
+			is_pipeline = true;
+			if (sscanf(optarg, "%zu,%zu,%zu", &pipeline_config.stat_threads,
+					&pipeline_config.partial_threads, &pipeline_config.hash_threads) != 3) {
+				fprintf(stderr, "invalid pipeline threads: %s\n", optarg);
+				usage(argv[0]);
+			}
+			break;
+		case 'p':
+			is_partial = true;
+			break;
+		case 'r':
+			reference = optarg;
+			break;
+		case 's':
+			is_stats = true;
+			break;
+		case 'T':
+			pipeline_config.tree_size = strtoul(optarg, NULL, 10) << 20;
+			break;
+		case 'W':
+			workers_count = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			tile_size = MX_MAXIMUM(strtoul(optarg, NULL, 10), 1UL);
+			break;
+		case 'V':
+			if (strcmp(optarg, "trust") == 0)
+				pipeline_config.policy = VERIFY_TRUST;
+			else if (strcmp(optarg, "verify") == 0)
+				pipeline_config.policy = VERIFY_ALWAYS;
+			else if (strcmp(optarg, "weak") == 0)
+				pipeline_config.policy = VERIFY_WEAK;
+			else {
+				fprintf(stderr, "invalid verification policy: %s\n", optarg);
+				usage(argv[0]);
+			}
+			break;
+		case 'w':
+			is_watch = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
 
-	queue = mx_vector_create(sizeof(pair_t));
+	char *default_roots[] = { "random_data" };
+	char **roots = optind < argc ? argv + optind : default_roots;
+	size_t roots_length = optind < argc ? argc - optind : 1;
+
+	if (is_watch)
+		return watch_main(roots, roots_length);
+	if (is_pipeline) {
+		int status = pipeline_main(roots, roots_length);
+		if (is_stats)
+			reader_print_stats(stderr);
+		return status;
+	}
 
-	pthread_t thread_1;
-	pthread_create(&thread_1, NULL, &thread_main, NULL);
+	// lookups and manifests cover whole trees, so a manifest stands in for the
+	// directory it was written from; the other engines take the roots' own files
+	names = list_files(roots, roots_length, reference != NULL || manifest != NULL);
 
-	pthread_t thread_2;
-	pthread_create(&thread_2, NULL, &thread_main, NULL);
+	if (reference != NULL) {
+		struct stat st;
+		if (stat(reference, &st) != 0) {
+			fprintf(stderr, "stat() failed on %s: %s\n", reference, strerror(errno));
+			exit(1);
+		}
+		if (!S_ISDIR(st.st_mode))
+			return contain_main(names, NULL, reference);
+		return contain_main(names, list_files(&reference, 1, true), NULL);
+	}
+
+	if (manifest != NULL)
+		return scan_main(names, manifest);
+	if (is_partial)
+		return partial_main(names);
+	if (is_similar)
+		return similar_main(names, threshold);
+	if (in_flight != 0)
+		return async_main(names, in_flight);
+
+	size_t names_length = mx_vector_length(names);
 
-	/* pthread_t thread_3; */
-	/* pthread_create(&thread_3, NULL, &thread_main, NULL); */
+	devs = mx_vector_create_with(sizeof(dev_t), names_length);
+	for (size_t i = 0; i < names_length; i++) {
+		struct stat st;
+		devs[i] = stat(names[i], &st) == 0 ? st.st_dev : 0;
+	}
 
-	/* pthread_t thread_4; */
-	/* pthread_create(&thread_4, NULL, &thread_main, NULL); */
+	lanes = mx_vector_create(sizeof(lane_t));
 
-	names_length = 200;
+	// read the topology now so the page allocation counters cover the workers
+	if (is_placed)
+		affinity_nodes();
 
-	for (size_t i = 0; i < names_length; i++)
-	{
-		for (size_t j = 0; j < names_length; j++)
-		{
-			pair_t p = { .name_1 = names[i], .name_2 = names[j], .is_done = false };
-			enqueue_pair(&p);
+	if (workers_count == 0)
+		workers_count = choose_workers_count();
+	pthread_t *workers = malloc(workers_count * sizeof(pthread_t));
+	if (workers == NULL)
+		abort();
+	for (size_t w = 0; w < workers_count; w++) {
+		int error = pthread_create(&workers[w], NULL, &thread_main, (void *) w);
+		if (error != 0) {
+			fprintf(stderr, "pthread_create() failed: %s\n", strerror(error));
+			exit(1);
 		}
 	}
 
-	pair_t p = { .is_done = true };
-	enqueue_pair(&p);
-	enqueue_pair(&p);
-	/* enqueue_pair(&p); */
-	/* enqueue_pair(&p); */
-
-	pthread_join(thread_1, NULL);
-	pthread_join(thread_2, NULL);
-	/* pthread_join(thread_3, NULL); */
-	/* pthread_join(thread_4, NULL); */
-
-	/* while (true) { */
-	/* 	pthread_mutex_lock(&results_mutex); */
-	/* 	if (results_count == names_length * names_length) */
-	/* 		return 0; */
-	/* 	pthread_cond_wait(&results_cond, &results_mutex); */
-	/* 	pthread_mutex_unlock(&results_mutex); */
-	/* } */
+	// split the names into runs on the same device; layout_sort() put files of
+	// the same device next to each other
+	size_t *runs = mx_vector_create(sizeof(size_t));
+	for (size_t i = 0; i <= names_length; i++) {
+		if (i == 0 || i == names_length || devs[i] != devs[i - 1])
+			runs = mx_vector_append(runs, &i);
+	}
+
+	// tile the upper triangle of every block of runs a <= b
+	for (size_t a = 0; a + 1 < mx_vector_length(runs); a++) {
+		for (size_t b = a; b + 1 < mx_vector_length(runs); b++) {
+			for (size_t i = runs[a]; i < runs[a + 1]; i += tile_size) {
+				size_t j = a == b ? i : runs[b];
+				for (; j < runs[b + 1]; j += tile_size) {
+					tile_t t = {
+						.i_begin = i, .i_end = MX_MINIMUM(i + tile_size, runs[a + 1]),
+						.j_begin = j, .j_end = MX_MINIMUM(j + tile_size, runs[b + 1]),
+						.dev_1 = devs[i], .dev_2 = devs[j],
+						.is_done = false,
+					};
+					enqueue_tile(&t);
+				}
+			}
+		}
+	}
+	mx_vector_delete(runs);
+
+	tile_t t = { .is_done = true };
+	for (size_t w = 0; w < workers_count; w++)
+		enqueue_tile(&t);
+	for (size_t w = 0; w < workers_count; w++)
+		pthread_join(workers[w], NULL);
+	free(workers);
+
+	if (is_stats) {
+		reader_print_stats(stderr);
+		if (is_placed)
+			affinity_print_stats(stderr);
+	}
 
 	return 1;
 }
@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mx/string.h"
+#include "mx/vector.h"
+#include "manifest.h"
+
+struct _manifest_t
+{
+	void *base;
+	size_t size;
+	const manifest_header_t *header;
+	const manifest_record_t *records;
+	const char *paths;
+};
+
+int manifest_record_cmp(const void *a, const void *b) {
+	const manifest_record_t *record_a = a, *record_b = b;
+	if (record_a->size != record_b->size)
+		return record_a->size < record_b->size ? -1 : 1;
+	if (record_a->partial != record_b->partial)
+		return record_a->partial < record_b->partial ? -1 : 1;
+	if (record_a->digest != record_b->digest)
+		return record_a->digest < record_b->digest ? -1 : 1;
+	return 0;
+}
+
+bool manifest_save(char *name, manifest_entry_t *entries) {
+	size_t length = mx_vector_length(entries);
+
+	manifest_header_t header = {
+		.magic = MANIFEST_MAGIC,
+		.version = MANIFEST_VERSION,
+		.record_size = sizeof(manifest_record_t),
+		.records_length = length,
+		.paths_offset = sizeof(manifest_header_t) + length * sizeof(manifest_record_t),
+		.paths_size = 0,
+	};
+	for (size_t i = 0; i < length; i++) {
+		entries[i].record.path = header.paths_size;
+		header.paths_size += mx_string_length(entries[i].path) + 1;
+	}
+
+	mx_string_t partial = mx_string_create(NULL, 0);
+	partial = mx_string_catf(partial, "%s.partial", name);
+
+	FILE *out = fopen(partial, "w");
+	if (out == NULL) {
+		fprintf(stderr, "fopen() failed on %s: %s\n", partial, strerror(errno));
+		mx_string_delete(partial);
+		return false;
+	}
+
+	bool result = fwrite(&header, sizeof(header), 1, out) == 1;
+	for (size_t i = 0; result && i < length; i++)
+		result = fwrite(&entries[i].record, sizeof(manifest_record_t), 1, out) == 1;
+	for (size_t i = 0; result && i < length; i++)
+		result = fwrite(entries[i].path, mx_string_length(entries[i].path) + 1, 1,
+			out) == 1;
+
+	if (fclose(out) != 0 || !result || rename(partial, name) != 0) {
+		fprintf(stderr, "writing %s failed: %s\n", name, strerror(errno));
+		unlink(partial);
+		result = false;
+	}
+
+	mx_string_delete(partial);
+	return result;
+}
+
+manifest_t *manifest_open(char *name) {
+	int fd = open(name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "open() failed on %s: %s\n", name, strerror(errno));
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		fprintf(stderr, "fstat() failed on %s: %s\n", name, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	if ((size_t) st.st_size < sizeof(manifest_header_t)) {
+		fprintf(stderr, "%s isn't a manifest\n", name);
+		close(fd);
+		return NULL;
+	}
+
+	void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, "mmap() failed on %s: %s\n", name, strerror(errno));
+		return NULL;
+	}
+
+	const manifest_header_t *header = base;
+	uint64_t size = st.st_size;
+	const char *problem = NULL;
+	if (header->magic != MANIFEST_MAGIC)
+		problem = "isn't a manifest";
+	else if (header->version != MANIFEST_VERSION)
+		problem = "has an unsupported version";
+	else if (header->record_size != sizeof(manifest_record_t) ||
+			header->records_length > (size - sizeof(manifest_header_t)) /
+				sizeof(manifest_record_t) ||
+			header->paths_offset != sizeof(manifest_header_t) +
+				header->records_length * sizeof(manifest_record_t) ||
+			header->paths_size != size - header->paths_offset)
+		problem = "is truncated or corrupt";
+	else if (header->paths_size != 0 && ((char *) base)[size - 1] != '\0')
+		problem = "has an unterminated path table";
+
+	if (problem != NULL) {
+		fprintf(stderr, "%s %s\n", name, problem);
+		munmap(base, st.st_size);
+		return NULL;
+	}
+
+	manifest_t *manifest = malloc(sizeof(manifest_t));
+	if (manifest == NULL)
+		abort();
+	manifest->base = base;
+	manifest->size = st.st_size;
+	manifest->header = header;
+	manifest->records = (const manifest_record_t *) (header + 1);
+	manifest->paths = (const char *) base + header->paths_offset;
+	return manifest;
+}
+
+void manifest_close(manifest_t *manifest) {
+	munmap(manifest->base, manifest->size);
+	free(manifest);
+}
+
+size_t manifest_length(manifest_t *manifest) {
+	return manifest->header->records_length;
+}
+
+const manifest_record_t *manifest_record(manifest_t *manifest, size_t i) {
+	return &manifest->records[i];
+}
+
+const char *manifest_path(manifest_t *manifest, const manifest_record_t *record) {
+	// the path table ends with a NUL so any offset inside it is terminated
+	if (record->path >= manifest->header->paths_size)
+		return NULL;
+	return manifest->paths + record->path;
+}
+
+size_t manifest_search(manifest_t *manifest, const manifest_record_t *record) {
+	size_t low = 0, high = manifest_length(manifest);
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		if (manifest_record_cmp(&manifest->records[middle], record) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
@@ -0,0 +1,104 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mx/string.h"
+
+/// The number of leading bytes of a file hashed into its partial digest
+#define MANIFEST_PARTIAL_SIZE 4096
+
+/// "dupesmf\0" in little endian; a manifest from a foreign byte order fails it
+#define MANIFEST_MAGIC UINT64_C(0x00666d7365707564)
+/// Version 2 hashes bytes as unsigned so digests agree across architectures
+#define MANIFEST_VERSION 2
+
+/**
+ * @brief The header at the start of a manifest
+ *
+ * A manifest is a header, then an array of records sorted by key (size,
+ * partial digest, digest), then a path table of NUL-terminated paths. Every
+ * field is in the byte order of the machine that wrote it and naturally
+ * aligned, so a manifest is used in place once mapped.
+ */
+typedef struct _manifest_header_t
+{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t record_size;   // sizeof(manifest_record_t) when written
+	uint64_t records_length;
+	uint64_t paths_offset;  // the records end where the path table starts
+	uint64_t paths_size;
+} manifest_header_t;
+
+typedef struct _manifest_record_t
+{
+	int64_t size;
+	uint64_t partial; // the FNV-1a hash of the first MANIFEST_PARTIAL_SIZE bytes
+	uint64_t digest;  // the FNV-1a hash of the whole content
+	uint64_t path;    // the offset of the path in the path table
+} manifest_record_t;
+
+/**
+ * @brief A record to be saved and its path
+ *
+ * The record is the first member so manifest_record_cmp() orders entries too.
+ */
+typedef struct _manifest_entry_t
+{
+	manifest_record_t record;
+	mx_string_t path;
+} manifest_entry_t;
+
+typedef struct _manifest_t manifest_t;
+
+/// Compare the keys (size, partial digest, digest) of two records
+int manifest_record_cmp(const void *a, const void *b);
+
+/**
+ * @brief Write the @a entries, sorted by key, as a manifest to the file at
+ *        @a name
+ *
+ * The manifest is written next to @a name and renamed over it when complete,
+ * so a reader never maps a manifest that is still being written.
+ *
+ * @return whether the manifest was written; a failure is reported
+ */
+bool manifest_save(char *name, manifest_entry_t *entries);
+
+/**
+ * @brief Map the manifest in the file at @a name
+ *
+ * Only the header is checked, so opening takes the same time however many
+ * records there are; the records and paths are paged in as they are used.
+ *
+ * @return the manifest on success; otherwise NULL and the failure is reported
+ */
+manifest_t *manifest_open(char *name);
+
+/// Unmap and deallocate the @a manifest
+void manifest_close(manifest_t *manifest);
+
+/// Return the number of records in the @a manifest
+size_t manifest_length(manifest_t *manifest);
+
+/// Return the record @a i of the @a manifest
+const manifest_record_t *manifest_record(manifest_t *manifest, size_t i);
+
+/**
+ * @brief Return the path of the @a record of the @a manifest, or NULL if its
+ *        offset is outside the path table
+ */
+const char *manifest_path(manifest_t *manifest, const manifest_record_t *record);
+
+/**
+ * @brief Return the index of the first record of the @a manifest whose key is
+ *        not less than the key of @a record
+ *
+ * This is a binary search, so the records of a key are found in O(log n).
+ */
+size_t manifest_search(manifest_t *manifest, const manifest_record_t *record);
+
+#endif /* MANIFEST_H */
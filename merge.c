@@ -0,0 +1,152 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mx/vector.h"
+#include "manifest.h"
+
+/// A manifest being merged and the index of its next record
+typedef struct _source_t
+{
+	char *name;
+	manifest_t *manifest;
+	size_t next;
+} source_t;
+
+/// A member of the set being gathered and the source it came from
+typedef struct _member_t
+{
+	const char *path;
+	size_t source;
+} member_t;
+
+static const manifest_record_t *head(source_t *source) {
+	if (source->next == manifest_length(source->manifest))
+		return NULL;
+	return manifest_record(source->manifest, source->next);
+}
+
+static const char *path_of(source_t *source, const manifest_record_t *record) {
+	const char *path = manifest_path(source->manifest, record);
+	if (path == NULL) {
+		fprintf(stderr, "%s has a path outside its path table\n", source->name);
+		exit(1);
+	}
+	return path;
+}
+
+static void advance(source_t *source) {
+	const manifest_record_t *previous = head(source);
+	source->next++;
+
+	const manifest_record_t *next = head(source);
+	if (next != NULL && manifest_record_cmp(previous, next) > 0) {
+		fprintf(stderr, "%s isn't sorted\n", source->name);
+		exit(1);
+	}
+}
+
+static void list(source_t *source) {
+	for (size_t i = 0; i < manifest_length(source->manifest); i++) {
+		const manifest_record_t *record = manifest_record(source->manifest, i);
+		printf("%lld %016" PRIx64 " %016" PRIx64 " %s\n", (long long) record->size,
+			record->partial, record->digest, path_of(source, record));
+	}
+}
+
+void usage(char *program) {
+	fprintf(stderr, "usage: %s [-lx] manifest ...\n", program);
+	fprintf(stderr, "  -l  print the records of the manifests as text instead\n");
+	fprintf(stderr, "  -x  only print sets with files from more than one manifest\n");
+	exit(2);
+}
+
+/**
+ * Merge the manifests written by `main -o` on any number of nodes or shards and
+ * print every set of files with the same size, partial digest and digest. The
+ * manifests are sorted by that key, so they are merged in one streaming pass
+ * that only holds the set being gathered.
+ */
+int main(int argc, char **argv)
+{
+	bool is_list = false;
+	bool is_cross = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "lx")) != -1) {
+		switch (opt) {
+		case 'l':
+			is_list = true;
+			break;
+		case 'x':
+			is_cross = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind == argc)
+		usage(argv[0]);
+
+	size_t sources_length = argc - optind;
+	source_t *sources = calloc(sources_length, sizeof(source_t));
+	if (sources == NULL)
+		abort();
+
+	for (size_t k = 0; k < sources_length; k++) {
+		sources[k].name = argv[optind + k];
+		if ((sources[k].manifest = manifest_open(sources[k].name)) == NULL)
+			exit(1);
+		if (is_list)
+			list(&sources[k]);
+	}
+
+	member_t *members = mx_vector_create(sizeof(member_t));
+	size_t sets_length = 0;
+
+	while (!is_list) {
+		// the least key among the heads of the sources is the next set
+		const manifest_record_t *key = NULL;
+		for (size_t k = 0; k < sources_length; k++) {
+			const manifest_record_t *record = head(&sources[k]);
+			if (record != NULL && (key == NULL || manifest_record_cmp(record, key) < 0))
+				key = record;
+		}
+		if (key == NULL)
+			break;
+
+		// the key stays mapped while its source advances
+		bool is_cross_set = false;
+		for (size_t k = 0; k < sources_length; k++) {
+			const manifest_record_t *record;
+			while ((record = head(&sources[k])) != NULL &&
+					manifest_record_cmp(record, key) == 0) {
+				member_t member = { .path = path_of(&sources[k], record), .source = k };
+				is_cross_set |= mx_vector_length(members) > 0 &&
+					members[0].source != k;
+				members = mx_vector_append(members, &member);
+				advance(&sources[k]);
+			}
+		}
+
+		if (mx_vector_length(members) >= 2 && (!is_cross || is_cross_set)) {
+			for (size_t m = 0; m < mx_vector_length(members); m++)
+				printf(m == 0 ? "%s" : ", %s", members[m].path);
+			printf("\n");
+			sets_length++;
+		}
+		members = mx_vector_truncate(members, 0);
+	}
+
+	if (!is_list)
+		fprintf(stderr, "%zu duplicate sets in %zu manifests\n", sets_length,
+			sources_length);
+
+	for (size_t k = 0; k < sources_length; k++)
+		manifest_close(sources[k].manifest);
+	mx_vector_delete(members);
+	free(sources);
+	return 0;
+}
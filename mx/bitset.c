@@ -4,12 +4,17 @@
 #include <stdio.h>
 #include <string.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MX_BITSET_X86
+#endif
+
 #include "common.h"
 #include "bitset.h"
 
 typedef struct _header_t {
   size_t volume;
-  unsigned int data[];
+  uint64_t data[];
 } header_t;
 
 /// Return the number of units in a bitset with @a volume bits
@@ -29,11 +34,23 @@ static header_t *bitset_to_header(mx_bitset_t bitset) {
   return (header_t *) ((char *) bitset - offsetof(header_t, data));
 }
 
+/// Return the mask of the used bits of the last unit of a bitset of @a volume
+static uint64_t tail_mask(size_t volume) {
+  size_t offset = volume % MX_BITSET_UNIT_BITS;
+  return offset == 0 ? ~UINT64_C(0) : (UINT64_C(1) << offset) - 1;
+}
+
+/// Return unit @a i of the @a bitset with its extraneous bits reset
+static uint64_t unit_at(mx_bitset_t bitset, size_t i, size_t length) {
+  return i + 1 == length ? bitset[i] & tail_mask(mx_bitset_volume(bitset)) :
+    bitset[i];
+}
+
 mx_bitset_t mx_bitset_create(size_t volume) {
   header_t *header;
   size_t length = volume_to_length(volume);
   size_t size;
-  
+
   // Calculate size and check for overflow
   if (mx_mulz_overflow(length, MX_BITSET_UNIT_SIZE, &size))
     return NULL;
@@ -79,13 +96,13 @@ bool mx_bitset_get(mx_bitset_t bitset, size_t i) {
 void mx_bitset_reset(mx_bitset_t bitset, size_t i) {
   size_t unit_i = i / MX_BITSET_UNIT_BITS;
   size_t offset = i % MX_BITSET_UNIT_BITS;
-  bitset[unit_i] &= ~(1U << offset);
+  bitset[unit_i] &= ~(UINT64_C(1) << offset);
 }
 
 void mx_bitset_set(mx_bitset_t bitset, size_t i) {
   size_t unit_i = i / MX_BITSET_UNIT_BITS;
   size_t offset = i % MX_BITSET_UNIT_BITS;
-  bitset[unit_i] |= 1U << offset;
+  bitset[unit_i] |= UINT64_C(1) << offset;
 }
 
 void mx_bitset_assign(mx_bitset_t bitset, size_t i, bool x) {
@@ -95,17 +112,15 @@ void mx_bitset_assign(mx_bitset_t bitset, size_t i, bool x) {
 void mx_bitset_toggle(mx_bitset_t bitset, size_t i) {
   size_t unit_i = i / MX_BITSET_UNIT_BITS;
   size_t offset = i % MX_BITSET_UNIT_BITS;
-  bitset[unit_i] ^= 1U << offset;
+  bitset[unit_i] ^= UINT64_C(1) << offset;
 }
 
 void mx_bitset_zero(mx_bitset_t bitset) {
-  unsigned int number = 0U;
-  memset(bitset, number, mx_bitset_length(bitset) * MX_BITSET_UNIT_SIZE);
+  memset(bitset, 0, mx_bitset_length(bitset) * MX_BITSET_UNIT_SIZE);
 }
 
 void mx_bitset_unzero(mx_bitset_t bitset) {
-  unsigned int number = ~0U;
-  memset(bitset, number, mx_bitset_length(bitset) * MX_BITSET_UNIT_SIZE);
+  memset(bitset, 0xff, mx_bitset_length(bitset) * MX_BITSET_UNIT_SIZE);
 }
 
 void mx_bitset_invert(mx_bitset_t bitset) {
@@ -126,63 +141,111 @@ void mx_bitset_sanitize(mx_bitset_t bitset, bool x) {
   // we don't need to adjust this calculation
   size_t tail_i = mx_bitset_volume(bitset) / MX_BITSET_UNIT_BITS;
 
-  unsigned int mask = (1U << offset) - 1;
+  uint64_t mask = (UINT64_C(1) << offset) - 1;
 
   bitset[tail_i] = x ? bitset[tail_i] | ~mask : bitset[tail_i] & mask;
 }
 
-void mx_bitset_and(mx_bitset_t a, mx_bitset_t b) {
-  size_t a_length = mx_bitset_length(a);
-  size_t b_length = mx_bitset_length(b);
-  size_t length = MX_MINIMUM(a_length, b_length);
+enum { OP_AND, OP_OR, OP_XOR };
+
+/// Apply @a op to the first @a length units of @a a and @a b, one at a time
+static void apply_units(int op, uint64_t *a, const uint64_t *b, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (op == OP_AND)
+      a[i] &= b[i];
+    else if (op == OP_OR)
+      a[i] |= b[i];
+    else
+      a[i] ^= b[i];
+  }
+}
 
-  if (b_length <= a_length)
-    mx_bitset_sanitize(b, 1);
+#ifdef MX_BITSET_X86
+/// Like apply_units() but four units at a time in 256-bit registers
+__attribute__((target("avx2")))
+static void apply_units_avx2(int op, uint64_t *a, const uint64_t *b,
+  size_t length) {
+  size_t i = 0;
+
+  for (; i + 4 <= length; i += 4) {
+    __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *) (b + i));
+    if (op == OP_AND)
+      x = _mm256_and_si256(x, y);
+    else if (op == OP_OR)
+      x = _mm256_or_si256(x, y);
+    else
+      x = _mm256_xor_si256(x, y);
+    _mm256_storeu_si256((__m256i *) (a + i), x);
+  }
 
-  for (size_t i = 0; i < length; i++)
-    a[i] &= b[i];
+  apply_units(op, a + i, b + i, length - i);
 }
+#endif
 
-void mx_bitset_or(mx_bitset_t a, mx_bitset_t b) {
+/**
+ * Apply @a op to @a a and @a b over the shorter of the two. When @a b is the
+ * shorter its extraneous bits are masked so they leave @a a unchanged.
+ */
+static void apply(int op, mx_bitset_t a, mx_bitset_t b) {
   size_t a_length = mx_bitset_length(a);
   size_t b_length = mx_bitset_length(b);
   size_t length = MX_MINIMUM(a_length, b_length);
 
-  if (b_length <= a_length)
-    mx_bitset_sanitize(b, 0);
+  if (length == 0)
+    return;
 
-  for (size_t i = 0; i < length; i++)
-    a[i] |= b[i];
+  // the last unit is applied on its own so that b isn't written to
+  size_t bulk = b_length <= a_length ? length - 1 : length;
+
+#ifdef MX_BITSET_X86
+  if (__builtin_cpu_supports("avx2"))
+    apply_units_avx2(op, a, b, bulk);
+  else
+#endif
+    apply_units(op, a, b, bulk);
+
+  if (bulk == length)
+    return;
+
+  uint64_t mask = tail_mask(mx_bitset_volume(b));
+  if (op == OP_AND)
+    a[bulk] &= b[bulk] | ~mask;
+  else if (op == OP_OR)
+    a[bulk] |= b[bulk] & mask;
+  else
+    a[bulk] ^= b[bulk] & mask;
 }
 
-void mx_bitset_xor(mx_bitset_t a, mx_bitset_t b) {
-  size_t a_length = mx_bitset_length(a);
-  size_t b_length = mx_bitset_length(b);
-  size_t length = MX_MINIMUM(a_length, b_length);
+void mx_bitset_and(mx_bitset_t a, mx_bitset_t b) {
+  apply(OP_AND, a, b);
+}
 
-  if (b_length <= a_length)
-    mx_bitset_sanitize(b, 0);
+void mx_bitset_or(mx_bitset_t a, mx_bitset_t b) {
+  apply(OP_OR, a, b);
+}
 
-  for (size_t i = 0; i < length; i++)
-    a[i] ^= b[i];
+void mx_bitset_xor(mx_bitset_t a, mx_bitset_t b) {
+  apply(OP_XOR, a, b);
 }
 
 bool mx_bitset_all(mx_bitset_t bitset) {
-  mx_bitset_sanitize(bitset, 1);
+  size_t length = mx_bitset_length(bitset);
 
-  for (size_t i = 0; i < mx_bitset_length(bitset); i++) {
-    if (bitset[i] != ~0U)
+  for (size_t i = 0; i + 1 < length; i++) {
+    if (bitset[i] != ~UINT64_C(0))
       return false;
   }
 
-  return true;
+  uint64_t mask = tail_mask(mx_bitset_volume(bitset));
+  return length == 0 || (bitset[length - 1] & mask) == mask;
 }
 
 bool mx_bitset_any(mx_bitset_t bitset) {
-  mx_bitset_sanitize(bitset, 0);
+  size_t length = mx_bitset_length(bitset);
 
-  for (size_t i = 0; i < mx_bitset_length(bitset); i++) {
-    if (bitset[i] != 0U)
+  for (size_t i = 0; i < length; i++) {
+    if (unit_at(bitset, i, length) != 0)
       return true;
   }
 
@@ -190,48 +253,95 @@ bool mx_bitset_any(mx_bitset_t bitset) {
 }
 
 bool mx_bitset_none(mx_bitset_t bitset) {
-  mx_bitset_sanitize(bitset, 0);
+  return !mx_bitset_any(bitset);
+}
 
-  for (size_t i = 0; i < mx_bitset_length(bitset); i++) {
-    if (bitset[i] != 0U)
-      return false;
-  }
+/// Return the number of bits set in the first @a length units of @a units
+static size_t count_units(const uint64_t *units, size_t length) {
+  size_t result = 0;
 
-  return true;
+  for (size_t i = 0; i < length; i++)
+    result += __builtin_popcountll(units[i]);
+
+  return result;
 }
 
-size_t mx_bitset_popcnt(mx_bitset_t bitset) {
+#ifdef MX_BITSET_X86
+/// Like count_units() but with the POPCNT instruction
+__attribute__((target("popcnt")))
+static size_t count_units_popcnt(const uint64_t *units, size_t length) {
   size_t result = 0;
 
-  mx_bitset_sanitize(bitset, 0);
-
-  for (size_t i = 0; i < mx_bitset_length(bitset); i++)
-    result += __builtin_popcount(bitset[i]);
+  for (size_t i = 0; i < length; i++)
+    result += __builtin_popcountll(units[i]);
 
   return result;
 }
+#endif
+
+size_t mx_bitset_popcnt(mx_bitset_t bitset) {
+  size_t length = mx_bitset_length(bitset);
+  size_t result;
+
+  if (length == 0)
+    return 0;
+
+#ifdef MX_BITSET_X86
+  if (__builtin_cpu_supports("popcnt"))
+    result = count_units_popcnt(bitset, length - 1);
+  else
+#endif
+    result = count_units(bitset, length - 1);
+
+  return result + __builtin_popcountll(unit_at(bitset, length - 1, length));
+}
 
 size_t mx_bitset_next(mx_bitset_t bitset, size_t i) {
+  size_t length = mx_bitset_length(bitset);
   size_t unit_i = i / MX_BITSET_UNIT_BITS;
   size_t offset = i % MX_BITSET_UNIT_BITS;
-  size_t result;
 
   if (i >= mx_bitset_volume(bitset))
     return MX_ABSENT;
 
-  mx_bitset_sanitize(bitset, 0);
+  uint64_t unit = unit_at(bitset, unit_i, length) >> offset;
+  if (unit != 0)
+    return i + __builtin_ctzll(unit);
 
-  if ((result = __builtin_ffs(bitset[unit_i] >> offset)) != 0)
-    return unit_i * MX_BITSET_UNIT_BITS + offset + result - 1;
-
-  for (unit_i++; unit_i < mx_bitset_length(bitset); unit_i++) {
-    if ((result = __builtin_ffs(bitset[unit_i])) != 0)
-      return unit_i * MX_BITSET_UNIT_BITS + result - 1;
+  for (unit_i++; unit_i < length; unit_i++) {
+    if ((unit = unit_at(bitset, unit_i, length)) != 0)
+      return unit_i * MX_BITSET_UNIT_BITS + __builtin_ctzll(unit);
   }
 
   return MX_ABSENT;
 }
 
+mx_bitset_iter_t mx_bitset_iter(mx_bitset_t bitset) {
+  size_t length = mx_bitset_length(bitset);
+  mx_bitset_iter_t iter = { .bitset = bitset, .unit_i = 0, .unit = 0 };
+
+  if (length != 0)
+    iter.unit = unit_at(bitset, 0, length);
+
+  return iter;
+}
+
+size_t mx_bitset_iter_next(mx_bitset_iter_t *iter) {
+  size_t length = mx_bitset_length(iter->bitset);
+
+  // skip the empty units; the iterator stays on the last unit once done
+  while (iter->unit == 0) {
+    if (iter->unit_i + 1 >= length)
+      return MX_ABSENT;
+    iter->unit_i++;
+    iter->unit = unit_at(iter->bitset, iter->unit_i, length);
+  }
+
+  size_t result = iter->unit_i * MX_BITSET_UNIT_BITS + __builtin_ctzll(iter->unit);
+  iter->unit &= iter->unit - 1; // reset the lowest set bit
+  return result;
+}
+
 void mx_bitset_debug(mx_bitset_t bitset) {
   fprintf(stderr, "mx_bitset_t(%p, [", bitset);
   for (size_t i = 0; i < mx_bitset_volume(bitset); i++)
@@ -6,10 +6,26 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define MX_BITSET_UNIT_SIZE sizeof(unsigned int)
+#include "common.h"
+
+#define MX_BITSET_UNIT_SIZE sizeof(uint64_t)
 #define MX_BITSET_UNIT_BITS (MX_BITSET_UNIT_SIZE * CHAR_BIT)
 
-typedef unsigned int * mx_bitset_t;
+/**
+ * A bitset is an array of 64-bit units. The bits past the volume in the last
+ * unit (the extraneous bits) may hold anything; every query masks them off
+ * rather than writing to the bitset, so queries are safe on a bitset that
+ * other threads are only reading.
+ */
+typedef uint64_t * mx_bitset_t;
+
+/// An iterator over the set bits of a bitset; see mx_bitset_iter()
+typedef struct _mx_bitset_iter_t
+{
+  mx_bitset_t bitset;
+  size_t unit_i; // the index of the unit being iterated
+  uint64_t unit; // the bits of the unit not yet returned
+} mx_bitset_iter_t;
 
 /**
  * @brief Allocate and initialize a bitset to hold @a volume bits
@@ -73,14 +89,21 @@ void mx_bitset_invert(mx_bitset_t bitset);
 
 #define mx_bitset_not mx_bitset_invert
 
-/// Reset (or set if @a x is true) extraneous bits in the @a bitset
+/**
+ * @brief Reset (or set if @a x is true) extraneous bits in the @a bitset
+ *
+ * Queries mask the extraneous bits themselves so this is only needed before
+ * reading the units directly.
+ */
 void mx_bitset_sanitize(mx_bitset_t bitset, bool x);
 
 /**
  * @brief Calculate the bitwise AND of the bits in @a with the bits in @a b
  *
  * The result will be stored in @a a. If @a a and @a b don't have the same
- * volume then the shorter of the two will be used.
+ * volume then the shorter of the two will be used. @a b isn't written to.
+ *
+ * Bulk operations run four units at a time with AVX2 where the CPU has it.
  */
 void mx_bitset_and(mx_bitset_t a, mx_bitset_t b);
 
@@ -100,9 +123,29 @@ bool mx_bitset_none(mx_bitset_t bitset);
 /// Return the number of bits set in the @a bitset
 size_t mx_bitset_popcnt(mx_bitset_t bitset);
 
-/// Return the index of the next bit set in the @a bitset (inclusive of @a i)
+/**
+ * @brief Return the index of the next bit set in the @a bitset (inclusive of
+ *        @a i)
+ *
+ * @return the index on success; otherwise MX_ABSENT
+ */
 size_t mx_bitset_next(mx_bitset_t bitset, size_t i);
 
+/**
+ * @brief Return an iterator over the bits set in the @a bitset
+ *
+ * Iterate over the @a bitset with:
+ *   mx_bitset_iter_t iter = mx_bitset_iter(bitset);
+ *   for (size_t i; (i = mx_bitset_iter_next(&iter)) != MX_ABSENT;)
+ * Each step costs the same however sparse the bitset is within a unit, unlike
+ * calling mx_bitset_next() with the last index plus one. Bits changed in units
+ * the iterator has already reached may or may not be seen.
+ */
+mx_bitset_iter_t mx_bitset_iter(mx_bitset_t bitset);
+
+/// Return the index of the next bit set for the @a iter or MX_ABSENT at the end
+size_t mx_bitset_iter_next(mx_bitset_iter_t *iter);
+
 void mx_bitset_debug(mx_bitset_t bitset);
 
 #endif /* MX_BITSET_H */
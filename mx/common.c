@@ -5,9 +5,24 @@ int mx_voidp_eq(const void *a, const void *b) {
 }
 
 uint64_t mx_fnv1a(char *string, size_t length) {
-  uint64_t hash = UINT64_C(14695981039346656037);
+  return mx_fnv1a_extend(MX_FNV1A_BASIS, string, length);
+}
+
+uint64_t mx_fnv1a_extend(uint64_t hash, char *string, size_t length) {
+  // hash octets so the result doesn't depend on whether char is signed
   for (size_t i = 0; i < length; i++) {
-    hash = (hash ^ string[i]) * UINT64_C(1099511628211);
+    hash = (hash ^ (unsigned char) string[i]) * UINT64_C(1099511628211);
+  }
+  return hash;
+}
+
+uint64_t mx_fnv1a_zeros(uint64_t hash, uint64_t length) {
+  // exponentiation by squaring of the prime modulo 2^64
+  uint64_t power = UINT64_C(1099511628211);
+  for (; length > 0; length >>= 1) {
+    if (length & 1)
+      hash *= power;
+    power *= power;
   }
   return hash;
 }
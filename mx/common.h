@@ -40,9 +40,31 @@ typedef uint64_t (*mx_hash_f)(const void *x);
 /// Return whether the pointer at @a a is equal to @a b
 int mx_voidp_eq(const void *a, const void *b);
 
+/// The FNV-1a offset basis, which is the hash of a zero length string
+#define MX_FNV1A_BASIS UINT64_C(14695981039346656037)
+
 /// Return the FNV-1a hash of the @a string with @a length characters
 uint64_t mx_fnv1a(char *string, size_t length);
 
+/**
+ * @brief Continue the FNV-1a @a hash with the @a string of @a length characters
+ *
+ * Hashing a string in pieces gives the same result as hashing it whole:
+ *   mx_fnv1a_extend(mx_fnv1a(a, n), b, m) == mx_fnv1a(a ++ b, n + m)
+ * Where a ++ b is the concatenation of a and b. Characters are hashed as
+ * unsigned octets, so the hash is the same whether char is signed or not.
+ */
+uint64_t mx_fnv1a_extend(uint64_t hash, char *string, size_t length);
+
+/**
+ * @brief Continue the FNV-1a @a hash with @a length NUL characters
+ *
+ * This gives the same result as mx_fnv1a_extend() with a string of @a length
+ * NUL characters in O(log(@a length)) time. A NUL leaves the xor step of FNV-1a
+ * unchanged so the hash is just multiplied by the FNV prime @a length times.
+ */
+uint64_t mx_fnv1a_zeros(uint64_t hash, uint64_t length);
+
 #if SIZE_MAX == ULLONG_MAX
 #define mx_addz_overflow(a, b, c) __builtin_uaddll_overflow( \
   (unsigned long long) a, (unsigned long long) b, (unsigned long long *) c \
@@ -0,0 +1,191 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "map.h"
+
+enum { SLOT_EMPTY, SLOT_FULL, SLOT_TOMB };
+
+struct _mx_map_t {
+  size_t key_size;
+  size_t value_size;
+  mx_hash_f hashf;
+  mx_eq_f eqf;
+  size_t volume; // number of slots, zero or a power of two
+  size_t length; // number of full slots
+  size_t used;   // number of full and tombstoned slots
+  unsigned char *states;
+  char *keys;
+  char *values;
+};
+
+static uint64_t hash_key(mx_map_t map, const void *key) {
+  if (map->hashf != NULL)
+    return map->hashf(key);
+  return mx_fnv1a((char *) key, map->key_size);
+}
+
+static bool eq_key(mx_map_t map, const void *a, const void *b) {
+  if (map->eqf != NULL)
+    return map->eqf(a, b);
+  return memcmp(a, b, map->key_size) == 0;
+}
+
+/// Return the slot holding @a key or MX_ABSENT if there is none
+static size_t find_slot(mx_map_t map, const void *key) {
+  if (map->volume == 0)
+    return MX_ABSENT;
+
+  size_t mask = map->volume - 1;
+  for (size_t i = hash_key(map, key) & mask;; i = (i + 1) & mask) {
+    if (map->states[i] == SLOT_EMPTY)
+      return MX_ABSENT;
+    if (map->states[i] == SLOT_FULL && eq_key(map, mx_map_key_at(map, i), key))
+      return i;
+  }
+}
+
+/// Rehash every entry of the @a map into @a volume slots
+static bool rehash(mx_map_t map, size_t volume) {
+  size_t key_size, value_size;
+  unsigned char *states;
+  char *keys, *values;
+
+  // calculate sizes and test for overflow
+  if (mx_mulz_overflow(volume, map->key_size, &key_size))
+    return false;
+  if (mx_mulz_overflow(volume, map->value_size, &value_size))
+    return false;
+
+  states = calloc(volume, 1);
+  keys = malloc(key_size);
+  values = malloc(value_size);
+  if (states == NULL || keys == NULL || values == NULL) {
+    free(states);
+    free(keys);
+    free(values);
+    return false;
+  }
+
+  size_t mask = volume - 1;
+  for (size_t i = 0; (i = mx_map_next(map, i)) != MX_ABSENT; i++) {
+    void *key = mx_map_key_at(map, i);
+    size_t j = hash_key(map, key) & mask;
+    while (states[j] != SLOT_EMPTY)
+      j = (j + 1) & mask;
+    states[j] = SLOT_FULL;
+    memcpy(keys + j * map->key_size, key, map->key_size);
+    memcpy(values + j * map->value_size, mx_map_value_at(map, i),
+      map->value_size);
+  }
+
+  free(map->states);
+  free(map->keys);
+  free(map->values);
+
+  map->states = states;
+  map->keys = keys;
+  map->values = values;
+  map->volume = volume;
+  map->used = map->length;
+
+  return true;
+}
+
+mx_map_t mx_map_create(size_t key_size, size_t value_size, mx_hash_f hashf,
+  mx_eq_f eqf) {
+  mx_map_t map;
+
+  if ((map = malloc(sizeof(struct _mx_map_t))) == NULL)
+    return NULL;
+
+  map->key_size = key_size;
+  map->value_size = value_size;
+  map->hashf = hashf;
+  map->eqf = eqf;
+  map->volume = 0;
+  map->length = 0;
+  map->used = 0;
+  map->states = NULL;
+  map->keys = NULL;
+  map->values = NULL;
+
+  return map;
+}
+
+void mx_map_delete(mx_map_t map) {
+  free(map->states);
+  free(map->keys);
+  free(map->values);
+  free(map);
+}
+
+size_t mx_map_length(mx_map_t map) {
+  return map->length;
+}
+
+void *mx_map_get(mx_map_t map, const void *key) {
+  size_t i = find_slot(map, key);
+  return i == MX_ABSENT ? NULL : mx_map_value_at(map, i);
+}
+
+void *mx_map_put(mx_map_t map, const void *key, const void *value) {
+  size_t i = find_slot(map, key);
+
+  if (i == MX_ABSENT) {
+    // keep the load (including tombstones) at or below three quarters; only
+    // grow if live entries alone would exceed half of the slots
+    if ((map->used + 1) * 4 > map->volume * 3) {
+      size_t volume = map->volume == 0 ? 8 : map->volume;
+      if ((map->length + 1) * 2 > volume && mx_mulz_overflow(volume, 2, &volume))
+        return NULL;
+      if (!rehash(map, volume))
+        return NULL;
+    }
+
+    size_t mask = map->volume - 1;
+    for (i = hash_key(map, key) & mask; map->states[i] == SLOT_FULL;)
+      i = (i + 1) & mask;
+
+    if (map->states[i] == SLOT_EMPTY)
+      map->used++;
+    map->states[i] = SLOT_FULL;
+    map->length++;
+    memcpy(mx_map_key_at(map, i), key, map->key_size);
+  }
+
+  if (value != NULL)
+    memcpy(mx_map_value_at(map, i), value, map->value_size);
+
+  return mx_map_value_at(map, i);
+}
+
+bool mx_map_remove(mx_map_t map, const void *key) {
+  size_t i = find_slot(map, key);
+
+  if (i == MX_ABSENT)
+    return false;
+
+  map->states[i] = SLOT_TOMB;
+  map->length--;
+
+  return true;
+}
+
+size_t mx_map_next(mx_map_t map, size_t i) {
+  for (; i < map->volume; i++) {
+    if (map->states[i] == SLOT_FULL)
+      return i;
+  }
+  return MX_ABSENT;
+}
+
+void *mx_map_key_at(mx_map_t map, size_t i) {
+  return map->keys + i * map->key_size;
+}
+
+void *mx_map_value_at(mx_map_t map, size_t i) {
+  return map->values + i * map->value_size;
+}
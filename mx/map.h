@@ -0,0 +1,73 @@
+#ifndef MX_MAP_H
+#define MX_MAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+
+typedef struct _mx_map_t * mx_map_t;
+
+/**
+ * @brief Allocate and initialize a map from keys of size @a key_size to values
+ *        of size @a value_size
+ *
+ * Keys are hashed with @a hashf and compared with @a eqf. Both are called with
+ * pointers to keys. If @a hashf is NULL then the FNV-1a hash of the bytes of
+ * the key is used. If @a eqf is NULL then keys are compared with memcmp().
+ *
+ * @return the map on success; otherwise NULL
+ */
+mx_map_t mx_map_create(size_t key_size, size_t value_size, mx_hash_f hashf,
+  mx_eq_f eqf);
+
+/// Raze and deallocate the @a map
+void mx_map_delete(mx_map_t map);
+
+/// Return the number of entries in the @a map
+size_t mx_map_length(mx_map_t map);
+
+/// Return a pointer to the value for @a key in the @a map; otherwise NULL
+void *mx_map_get(mx_map_t map, const void *key);
+
+/**
+ * @brief Copy @a key and the value at @a value into the @a map
+ *
+ * If the @a map already has an entry for @a key then only its value is
+ * replaced. If @a value is NULL then the value is left uninitialized for a new
+ * entry and unmodified for an existing one.
+ *
+ * Pointers returned by mx_map_get() or mx_map_put() are invalidated by any
+ * subsequent mx_map_put() of a new key.
+ *
+ * @return a pointer to the value in the @a map on success; otherwise NULL
+ */
+void *mx_map_put(mx_map_t map, const void *key, const void *value);
+
+/**
+ * @brief Remove the entry for @a key from the @a map
+ *
+ * @return whether the @a map had an entry for @a key
+ */
+bool mx_map_remove(mx_map_t map, const void *key);
+
+/**
+ * @brief Return the slot of the next entry in the @a map (inclusive of @a i)
+ *
+ * Iterate over the @a map with:
+ *   for (size_t i = 0; (i = mx_map_next(map, i)) != MX_ABSENT; i++)
+ * Removing the entry at slot @a i during iteration is allowed. Putting a new
+ * key is not.
+ *
+ * @return the slot on success; otherwise MX_ABSENT
+ */
+size_t mx_map_next(mx_map_t map, size_t i);
+
+/// Return a pointer to the key of the entry at slot @a i in the @a map
+void *mx_map_key_at(mx_map_t map, size_t i);
+
+/// Return a pointer to the value of the entry at slot @a i in the @a map
+void *mx_map_value_at(mx_map_t map, size_t i);
+
+#endif /* MX_MAP_H */
@@ -0,0 +1,121 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mx/map.h"
+#include "mx/string.h"
+#include "mx/vector.h"
+#include "chunk.h"
+#include "partial.h"
+#include "reader.h"
+
+/// Chunks in more files than this (runs of zeros, common headers) only count
+/// toward the dedupe summary; pairing them would be quadratic in their files
+#define MAX_SHARERS 256
+
+typedef struct _entry_t
+{
+	size_t length;
+	size_t occurrences;
+	size_t *files; // mx_vector_t of the ids of the files having the chunk
+} entry_t;
+
+typedef struct _pair_key_t
+{
+	size_t i;
+	size_t j;
+} pair_key_t;
+
+typedef struct _shared_t
+{
+	pair_key_t key;
+	uint64_t bytes;
+} shared_t;
+
+static int shared_cmp(const void *a, const void *b) {
+	const shared_t *shared_a = a, *shared_b = b;
+	if (shared_a->bytes != shared_b->bytes)
+		return shared_a->bytes > shared_b->bytes ? -1 : 1;
+	if (shared_a->key.i != shared_b->key.i)
+		return shared_a->key.i < shared_b->key.i ? -1 : 1;
+	return shared_a->key.j < shared_b->key.j ? -1 : shared_a->key.j > shared_b->key.j;
+}
+
+int partial_main(mx_string_t *names) {
+	mx_map_t chunks = mx_map_create(sizeof(uint64_t), sizeof(entry_t), NULL, NULL);
+	uint64_t total_bytes = 0;
+
+	for (size_t i = 0; i < mx_vector_length(names); i++) {
+		chunker_t chunker;
+		chunker_init(&chunker);
+		if (!file_scan(names[i], chunker_sink, &chunker)) {
+			chunker_raze(&chunker);
+			continue;
+		}
+		chunker_finish(&chunker);
+
+		for (size_t k = 0; k < mx_vector_length(chunker.chunks); k++) {
+			chunk_t *chunk = &chunker.chunks[k];
+			entry_t *entry = mx_map_get(chunks, &chunk->digest);
+			if (entry == NULL) {
+				entry_t created = { .length = chunk->length, .occurrences = 0 };
+				created.files = mx_vector_create(sizeof(size_t));
+				if ((entry = mx_map_put(chunks, &chunk->digest, &created)) == NULL)
+					abort();
+			}
+
+			entry->occurrences++;
+			size_t length = mx_vector_length(entry->files);
+			if (length == 0 || entry->files[length - 1] != i)
+				entry->files = mx_vector_append(entry->files, &i);
+			total_bytes += chunk->length;
+		}
+		chunker_raze(&chunker);
+	}
+
+	mx_map_t pairs = mx_map_create(sizeof(pair_key_t), sizeof(uint64_t), NULL, NULL);
+	uint64_t unique_bytes = 0;
+
+	for (size_t k = 0; (k = mx_map_next(chunks, k)) != MX_ABSENT; k++) {
+		entry_t *entry = mx_map_value_at(chunks, k);
+		size_t length = mx_vector_length(entry->files);
+		unique_bytes += entry->length;
+
+		for (size_t a = 0; length <= MAX_SHARERS && a < length; a++) {
+			for (size_t b = a + 1; b < length; b++) {
+				pair_key_t key = { .i = entry->files[a], .j = entry->files[b] };
+				uint64_t *bytes = mx_map_get(pairs, &key);
+				if (bytes == NULL) {
+					uint64_t zero = 0;
+					if ((bytes = mx_map_put(pairs, &key, &zero)) == NULL)
+						abort();
+				}
+				*bytes += entry->length;
+			}
+		}
+		mx_vector_delete(entry->files);
+	}
+	mx_map_delete(chunks);
+
+	shared_t *shared = mx_vector_create(sizeof(shared_t));
+	for (size_t k = 0; (k = mx_map_next(pairs, k)) != MX_ABSENT; k++) {
+		shared_t s = {
+			.key = *(pair_key_t *) mx_map_key_at(pairs, k),
+			.bytes = *(uint64_t *) mx_map_value_at(pairs, k),
+		};
+		shared = mx_vector_append(shared, &s);
+	}
+	mx_map_delete(pairs);
+
+	mx_vector_sort(shared, shared_cmp);
+	for (size_t k = 0; k < mx_vector_length(shared); k++) {
+		printf("%s, %s, %llu\n", names[shared[k].key.i], names[shared[k].key.j],
+			(unsigned long long) shared[k].bytes);
+	}
+	mx_vector_delete(shared);
+
+	fprintf(stderr, "%llu bytes in chunks, %llu unique; dedupe would save %llu\n",
+		(unsigned long long) total_bytes, (unsigned long long) unique_bytes,
+		(unsigned long long) (total_bytes - unique_bytes));
+	return 0;
+}
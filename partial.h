@@ -0,0 +1,18 @@
+#ifndef PARTIAL_H
+#define PARTIAL_H
+
+#include "mx/string.h"
+
+/**
+ * @brief Report the pairs of @a names that share content
+ *
+ * Every file is split into content-defined chunks and the chunk digests are
+ * indexed across all files. Each pair of files sharing chunks is printed as
+ * "name_1, name_2, shared bytes", most shared first, and a summary of how much
+ * block-level dedupe would save is printed to stderr.
+ *
+ * @return the exit status
+ */
+int partial_main(mx_string_t *names);
+
+#endif /* PARTIAL_H */
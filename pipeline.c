@@ -0,0 +1,529 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "mx/common.h"
+#include "mx/map.h"
+#include "mx/string.h"
+#include "mx/vector.h"
+#include "device.h"
+#include "pipeline.h"
+#include "queue.h"
+#include "reader.h"
+#include "sha256.h"
+#include "walk.h"
+
+/// The number of leading bytes hashed by the partial-hash stage
+#define PARTIAL_SIZE 4096
+
+pipeline_config_t pipeline_config = {
+	.stat_threads = 8,
+	.partial_threads = 2,
+	.hash_threads = 2,
+	.queue_length = 1024,
+	.is_strong = false,
+	.tree_size = 64 << 20,
+	.policy = VERIFY_WEAK,
+};
+
+/// A file on its way through the stages; each stage fills in more of it
+typedef struct _item_t
+{
+	mx_string_t path;
+	dev_t dev;
+	off_t size;
+	uint64_t partial;
+	unsigned char digest[SHA256_SIZE]; // an FNV-1a digest fills the first bytes
+} item_t;
+
+/// The key of the group stages; partial is zero until the partial-hash stage
+typedef struct _group_key_t
+{
+	off_t size;
+	uint64_t partial;
+} group_key_t;
+
+/// The key of the sets of the report stage
+typedef struct _set_key_t
+{
+	off_t size;
+	unsigned char digest[SHA256_SIZE];
+} set_key_t;
+
+/// The sets to verify, shared by the verify threads
+typedef struct _verify_t
+{
+	mx_string_t **sets; // mx_vector_t of mx_vector_t of paths
+	size_t next;        // the next set to take
+	pthread_mutex_t mutex;
+} verify_t;
+
+/// A file hashed as a tree whose leaves are ranges of tree_size bytes
+typedef struct _tree_t
+{
+	item_t *item;
+	size_t leaves; // the number of ranges
+	size_t next;   // the next range to take
+	size_t done;   // the number of ranges hashed
+	bool is_failed;
+	unsigned char (*digests)[SHA256_SIZE];
+} tree_t;
+
+/// The trees with ranges left to take, shared by the full-hash threads
+typedef struct _board_t
+{
+	tree_t **trees;  // mx_vector_t of trees
+	size_t popping;  // the threads still taking items from the queue
+	pthread_mutex_t mutex;
+	pthread_cond_t cond; // broadcast when a tree or the last range is added
+} board_t;
+
+/// The first item of a group and whether it was forwarded with the second
+typedef struct _held_t
+{
+	item_t item;
+	bool is_forwarded;
+} held_t;
+
+typedef struct _stage_t stage_t;
+
+struct _stage_t
+{
+	const char *name;
+	size_t threads;
+	void (*work)(stage_t *stage);
+	queue_t *in;  // NULL for the walk stage
+	queue_t *out; // NULL for the report stage
+	void *data;
+	pthread_t *ids;
+};
+
+/// Queue the file @a path for the stat stage
+static bool queue_file(void *data, const char *path) {
+	stage_t *stage = data;
+	item_t item = { .path = mx_string_create((char *) path, 0) };
+	queue_push(stage->out, &item);
+	return true;
+}
+
+static void walk_work(stage_t *stage) {
+	mx_string_t *roots = stage->data;
+	for (size_t i = 0; i < mx_vector_length(roots); i++)
+		walk_tree(roots[i], NULL, queue_file, stage);
+}
+
+static void stat_work(stage_t *stage) {
+	item_t item;
+	while (queue_pop(stage->in, &item)) {
+		struct stat st;
+		if (stat(item.path, &st) != 0 || !S_ISREG(st.st_mode)) {
+			mx_string_delete(item.path);
+			continue;
+		}
+		item.dev = st.st_dev;
+		item.size = st.st_size;
+		queue_push(stage->out, &item);
+	}
+}
+
+/**
+ * Forward the items whose key some other item shares. The first item of a key
+ * is held until a second one arrives; items left held at the end are unique.
+ */
+static void group_work(stage_t *stage) {
+	mx_map_t held = mx_map_create(sizeof(group_key_t), sizeof(held_t), NULL, NULL);
+
+	item_t item;
+	while (queue_pop(stage->in, &item)) {
+		group_key_t key = { .size = item.size, .partial = item.partial };
+		held_t *first = mx_map_get(held, &key);
+		if (first == NULL) {
+			held_t holding = { .item = item, .is_forwarded = false };
+			if (mx_map_put(held, &key, &holding) == NULL)
+				abort();
+			continue;
+		}
+
+		if (!first->is_forwarded) {
+			queue_push(stage->out, &first->item);
+			first->is_forwarded = true;
+		}
+		queue_push(stage->out, &item);
+	}
+
+	for (size_t i = 0; (i = mx_map_next(held, i)) != MX_ABSENT; i++) {
+		held_t *first = mx_map_value_at(held, i);
+		if (!first->is_forwarded)
+			mx_string_delete(first->item.path);
+	}
+	mx_map_delete(held);
+}
+
+static void partial_work(stage_t *stage) {
+	item_t item;
+	while (queue_pop(stage->in, &item)) {
+		item.partial = MX_FNV1A_BASIS;
+		if (!file_scan_head(item.path, PARTIAL_SIZE, digest_sink, &item.partial)) {
+			mx_string_delete(item.path);
+			continue;
+		}
+		queue_push(stage->out, &item);
+	}
+}
+
+/// Hash @a length bytes of @a path at @a offset into @a digest
+static bool hash_range(char *path, off_t offset, off_t length,
+		unsigned char digest[SHA256_SIZE]) {
+	memset(digest, 0, SHA256_SIZE);
+
+	if (pipeline_config.is_strong) {
+		sha256_t sha;
+		sha256_init(&sha);
+		if (!file_scan_range(path, offset, length, sha256_sink, &sha))
+			return false;
+		sha256_final(&sha, digest);
+		return true;
+	}
+
+	uint64_t hash = MX_FNV1A_BASIS;
+	if (!file_scan_range(path, offset, length, digest_sink, &hash))
+		return false;
+	memcpy(digest, &hash, sizeof(hash));
+	return true;
+}
+
+/// Hash the whole file of @a item into its digest
+static bool hash_item(item_t *item) {
+	// the partial hash of a small file is already its digest
+	if (!pipeline_config.is_strong && item->size <= PARTIAL_SIZE) {
+		memset(item->digest, 0, sizeof(item->digest));
+		memcpy(item->digest, &item->partial, sizeof(item->partial));
+		return true;
+	}
+	return hash_range(item->path, 0, -1, item->digest);
+}
+
+/// Take the next range of @a tree, or of any tree if NULL; call under the lock
+static bool take_leaf(board_t *board, tree_t **tree, size_t *leaf) {
+	for (size_t i = 0; i < mx_vector_length(board->trees); i++) {
+		tree_t *candidate = board->trees[i];
+		if (*tree != NULL && candidate != *tree)
+			continue;
+
+		*tree = candidate;
+		*leaf = candidate->next++;
+		if (candidate->next == candidate->leaves)
+			board->trees = mx_vector_remove(board->trees, i);
+		return true;
+	}
+	return false;
+}
+
+/// Hash the range @a leaf of @a tree under a read slot of its device
+static void hash_leaf(board_t *board, tree_t *tree, size_t leaf) {
+	off_t size = pipeline_config.tree_size;
+	item_t *item = tree->item;
+
+	device_enter(item->dev, item->dev);
+	bool result = hash_range(item->path, leaf * size, size, tree->digests[leaf]);
+	device_leave(item->dev, item->dev);
+
+	pthread_mutex_lock(&board->mutex);
+	tree->is_failed |= !result;
+	if (++tree->done == tree->leaves)
+		pthread_cond_broadcast(&board->cond);
+	pthread_mutex_unlock(&board->mutex);
+}
+
+/**
+ * Hash the file of @a item as a tree. Its ranges are posted to the @a board
+ * for the other threads and this one hashes them too until none are left,
+ * then waits for the ranges others took.
+ */
+static bool hash_tree(board_t *board, item_t *item) {
+	size_t size = pipeline_config.tree_size;
+	tree_t tree = {
+		.item = item,
+		.leaves = (item->size + size - 1) / size,
+		.next = 0,
+		.done = 0,
+		.is_failed = false,
+	};
+	if ((tree.digests = malloc(tree.leaves * SHA256_SIZE)) == NULL)
+		abort();
+
+	tree_t *posted = &tree;
+	pthread_mutex_lock(&board->mutex);
+	board->trees = mx_vector_append(board->trees, &posted);
+	pthread_cond_broadcast(&board->cond);
+
+	size_t leaf;
+	while (take_leaf(board, &posted, &leaf)) {
+		pthread_mutex_unlock(&board->mutex);
+		hash_leaf(board, &tree, leaf);
+		pthread_mutex_lock(&board->mutex);
+	}
+	while (tree.done < tree.leaves)
+		pthread_cond_wait(&board->cond, &board->mutex);
+	pthread_mutex_unlock(&board->mutex);
+
+	// the root is the hash of the leaf digests, which for FNV-1a are 8 bytes
+	memset(item->digest, 0, sizeof(item->digest));
+	if (pipeline_config.is_strong) {
+		sha256_t sha;
+		sha256_init(&sha);
+		sha256_update(&sha, (unsigned char *) tree.digests, tree.leaves * SHA256_SIZE);
+		sha256_final(&sha, item->digest);
+	} else {
+		uint64_t hash = MX_FNV1A_BASIS;
+		for (size_t i = 0; i < tree.leaves; i++)
+			hash = mx_fnv1a_extend(hash, (char *) tree.digests[i], sizeof(uint64_t));
+		memcpy(item->digest, &hash, sizeof(hash));
+	}
+
+	free(tree.digests);
+	return !tree.is_failed;
+}
+
+static void hash_work(stage_t *stage) {
+	board_t *board = stage->data;
+	size_t tree_size = pipeline_config.tree_size;
+
+	item_t item;
+	while (true) {
+		// help with the trees of other threads before taking another file
+		tree_t *tree = NULL;
+		size_t leaf;
+		pthread_mutex_lock(&board->mutex);
+		bool is_taken = take_leaf(board, &tree, &leaf);
+		pthread_mutex_unlock(&board->mutex);
+		if (is_taken) {
+			hash_leaf(board, tree, leaf);
+			continue;
+		}
+
+		if (!queue_pop(stage->in, &item))
+			break;
+
+		bool result;
+		if (tree_size != 0 && item.size > (off_t) tree_size)
+			result = hash_tree(board, &item);
+		else {
+			device_enter(item.dev, item.dev);
+			result = hash_item(&item);
+			device_leave(item.dev, item.dev);
+		}
+
+		if (result)
+			queue_push(stage->out, &item);
+		else
+			mx_string_delete(item.path);
+	}
+
+	// the queue is drained so help until no thread can post another tree
+	pthread_mutex_lock(&board->mutex);
+	board->popping--;
+	pthread_cond_broadcast(&board->cond);
+	while (true) {
+		tree_t *tree = NULL;
+		size_t leaf;
+		if (take_leaf(board, &tree, &leaf)) {
+			pthread_mutex_unlock(&board->mutex);
+			hash_leaf(board, tree, leaf);
+			pthread_mutex_lock(&board->mutex);
+		} else if (board->popping > 0)
+			pthread_cond_wait(&board->cond, &board->mutex);
+		else
+			break;
+	}
+	pthread_mutex_unlock(&board->mutex);
+}
+
+/// Print every class of two or more of the @a paths as a line
+static void print_classes(mx_string_t *paths, size_t *classes) {
+	size_t length = mx_vector_length(paths);
+
+	// verify threads print at once so keep each set's lines together
+	flockfile(stdout);
+	for (size_t i = 0; i < length; i++) {
+		size_t count = 0;
+		for (size_t j = i; classes[i] == i && j < length; j++)
+			count += classes[j] == i;
+		if (count < 2)
+			continue;
+
+		for (size_t j = i; j < length; j++) {
+			if (classes[j] == i)
+				printf(j == i ? "%s" : ", %s", paths[j]);
+		}
+		printf("\n");
+	}
+	funlockfile(stdout);
+}
+
+static void *verify_main(void *data) {
+	verify_t *verify = data;
+
+	while (true) {
+		pthread_mutex_lock(&verify->mutex);
+		size_t k = verify->next++;
+		pthread_mutex_unlock(&verify->mutex);
+		if (k >= mx_vector_length(verify->sets))
+			break;
+
+		mx_string_t *paths = verify->sets[k];
+		size_t *classes = malloc(mx_vector_length(paths) * sizeof(size_t));
+		if (classes == NULL)
+			abort();
+		is_same_files(paths, mx_vector_length(paths), classes);
+		print_classes(paths, classes);
+		free(classes);
+	}
+	return NULL;
+}
+
+static void report_work(stage_t *stage) {
+	mx_map_t sets = mx_map_create(sizeof(set_key_t), sizeof(mx_string_t *),
+		NULL, NULL);
+
+	item_t item;
+	while (queue_pop(stage->in, &item)) {
+		set_key_t key = { .size = item.size };
+		memcpy(key.digest, item.digest, sizeof(key.digest));
+		mx_string_t **paths = mx_map_get(sets, &key);
+		if (paths == NULL) {
+			mx_string_t *empty = mx_vector_create(sizeof(mx_string_t));
+			if ((paths = mx_map_put(sets, &key, &empty)) == NULL)
+				abort();
+		}
+		*paths = mx_vector_append(*paths, &item.path);
+	}
+
+	bool is_verified = pipeline_config.policy == VERIFY_ALWAYS ||
+		(pipeline_config.policy == VERIFY_WEAK && !pipeline_config.is_strong);
+	verify_t verify = { .sets = mx_vector_create(sizeof(mx_string_t *)), .next = 0 };
+	pthread_mutex_init(&verify.mutex, NULL);
+
+	for (size_t i = 0; (i = mx_map_next(sets, i)) != MX_ABSENT; i++) {
+		mx_string_t *paths = *(mx_string_t **) mx_map_value_at(sets, i);
+		if (mx_vector_length(paths) < 2)
+			continue;
+		if (is_verified) {
+			verify.sets = mx_vector_append(verify.sets, &paths);
+			continue;
+		}
+
+		size_t *classes = calloc(mx_vector_length(paths), sizeof(size_t));
+		if (classes == NULL)
+			abort();
+		print_classes(paths, classes);
+		free(classes);
+	}
+
+	// sets are verified in parallel, each by a k-way compare of its files
+	size_t threads = MX_MAXIMUM(pipeline_config.hash_threads, (size_t) 1);
+	pthread_t *ids = malloc(threads * sizeof(pthread_t));
+	if (ids == NULL)
+		abort();
+	for (size_t t = 0; t < threads; t++) {
+		if (pthread_create(&ids[t], NULL, verify_main, &verify) != 0) {
+			fprintf(stderr, "pthread_create() failed for verification\n");
+			exit(1);
+		}
+	}
+	for (size_t t = 0; t < threads; t++)
+		pthread_join(ids[t], NULL);
+	free(ids);
+
+	pthread_mutex_destroy(&verify.mutex);
+	mx_vector_delete(verify.sets);
+
+	for (size_t i = 0; (i = mx_map_next(sets, i)) != MX_ABSENT; i++) {
+		mx_string_t *paths = *(mx_string_t **) mx_map_value_at(sets, i);
+		for (size_t j = 0; j < mx_vector_length(paths); j++)
+			mx_string_delete(paths[j]);
+		mx_vector_delete(paths);
+	}
+	mx_map_delete(sets);
+}
+
+static void *stage_main(void *data) {
+	stage_t *stage = data;
+	stage->work(stage);
+	if (stage->out != NULL)
+		queue_close(stage->out);
+	return NULL;
+}
+
+int pipeline_main(char **roots, size_t roots_length) {
+	mx_string_t *paths = mx_vector_create(sizeof(mx_string_t));
+	for (size_t i = 0; i < roots_length; i++) {
+		mx_string_t root = mx_string_create(roots[i], 0);
+		paths = mx_vector_append(paths, &root);
+	}
+
+	board_t board = {
+		.trees = mx_vector_create(sizeof(tree_t *)),
+		.popping = MX_MAXIMUM(pipeline_config.hash_threads, (size_t) 1),
+	};
+	pthread_mutex_init(&board.mutex, NULL);
+	pthread_cond_init(&board.cond, NULL);
+
+	stage_t stages[] = {
+		{ .name = "walk", .threads = 1, .work = walk_work, .data = paths },
+		{ .name = "stat", .threads = pipeline_config.stat_threads, .work = stat_work },
+		{ .name = "size-group", .threads = 1, .work = group_work },
+		{ .name = "partial-hash", .threads = pipeline_config.partial_threads,
+			.work = partial_work },
+		{ .name = "partial-group", .threads = 1, .work = group_work },
+		{ .name = "full-hash", .threads = pipeline_config.hash_threads,
+			.work = hash_work, .data = &board },
+		{ .name = "report", .threads = 1, .work = report_work },
+	};
+	size_t stages_length = sizeof(stages) / sizeof(*stages);
+
+	// the queue after a stage has a producer per thread of the stage
+	for (size_t s = 0; s < stages_length; s++) {
+		stages[s].threads = MX_MAXIMUM(stages[s].threads, (size_t) 1);
+		if (s + 1 < stages_length) {
+			stages[s].out = queue_create(pipeline_config.queue_length, sizeof(item_t),
+				stages[s].threads);
+			if (stages[s].out == NULL)
+				abort();
+			stages[s + 1].in = stages[s].out;
+		}
+	}
+
+	for (size_t s = 0; s < stages_length; s++) {
+		if ((stages[s].ids = malloc(stages[s].threads * sizeof(pthread_t))) == NULL)
+			abort();
+		for (size_t t = 0; t < stages[s].threads; t++) {
+			if (pthread_create(&stages[s].ids[t], NULL, stage_main, &stages[s]) != 0) {
+				fprintf(stderr, "pthread_create() failed for the %s stage\n",
+					stages[s].name);
+				exit(1);
+			}
+		}
+	}
+
+	for (size_t s = 0; s < stages_length; s++) {
+		for (size_t t = 0; t < stages[s].threads; t++)
+			pthread_join(stages[s].ids[t], NULL);
+		free(stages[s].ids);
+	}
+	for (size_t s = 0; s + 1 < stages_length; s++)
+		queue_delete(stages[s].out);
+
+	pthread_cond_destroy(&board.cond);
+	pthread_mutex_destroy(&board.mutex);
+	mx_vector_delete(board.trees);
+
+	for (size_t i = 0; i < roots_length; i++)
+		mx_string_delete(paths[i]);
+	mx_vector_delete(paths);
+	return 0;
+}
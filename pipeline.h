@@ -0,0 +1,55 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum _verify_policy_t
+{
+	VERIFY_TRUST,  // trust the digest, whichever it is
+	VERIFY_ALWAYS, // confirm every set byte for byte
+	VERIFY_WEAK,   // confirm sets only when the digest is FNV-1a
+} verify_policy_t;
+
+typedef struct _pipeline_config_t
+{
+	size_t stat_threads;    // threads of the stat stage, for metadata
+	size_t partial_threads; // threads hashing the first block of files
+	size_t hash_threads;    // threads hashing whole files, device limited
+	size_t queue_length;    // the items each queue between stages holds
+	bool is_strong;         // hash whole files with SHA-256 rather than FNV-1a
+	size_t tree_size;       // the bytes of each range of a tree hash, or zero
+	verify_policy_t policy; // when sets are confirmed with is_same_files()
+} pipeline_config_t;
+
+/// The configuration of the pipeline; set it before pipeline_main()
+extern pipeline_config_t pipeline_config;
+
+/**
+ * @brief Print the duplicate sets of the files beneath @a roots through a
+ *        pipeline of concurrent stages
+ *
+ * The stages are walk, stat, size-group, partial-hash, partial-group,
+ * full-hash and report. Each runs on its own threads and hands items to the
+ * next through a bounded queue, so every stage works at once and a slow stage
+ * holds back the ones before it rather than letting items pile up. The group
+ * stages forward a file once another file shares its key, so files with a
+ * unique size or first block are never read further. Full hashes take a read
+ * slot of their device (see device_enter()).
+ *
+ * A file larger than the tree size is hashed as a tree: its ranges of that size
+ * are leaves that any full-hash thread may take and hash, and the digest is the
+ * hash of the leaf digests. A thread whose queue is drained helps with the
+ * trees still being hashed, so a few giant files at the end of a run are read
+ * by every full-hash thread rather than by one each.
+ *
+ * Once every file is hashed, the sets are verified as the policy says, one set
+ * per full-hash thread at a time, and printed as "name_1, name_2, ...". A
+ * verified set whose files turn out to differ is printed as the classes of
+ * identical files it splits into.
+ *
+ * @return the exit status
+ */
+int pipeline_main(char **roots, size_t roots_length);
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,188 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "mx/vector.h"
+#include "pool.h"
+
+/// The size of a huge page on x86-64 and the unit of the slabs of huge pools
+#define HUGE_PAGE_SIZE (2 << 20)
+
+/// A mapping that buffers of a huge pool are carved from
+typedef struct _slab_t
+{
+	char *base;
+	size_t size;
+} slab_t;
+
+struct _pool_t
+{
+	size_t buffer_size;
+	size_t alignment;
+	void **free; // mx_vector_t of released buffers
+	pthread_mutex_t mutex;
+	bool is_huge;
+	pool_backing_t backing; // of the latest slab of a huge pool
+	slab_t *slabs;          // mx_vector_t of the slabs of a huge pool
+	size_t carved;          // the bytes of the latest slab handed out
+};
+
+pool_t *pool_create(size_t buffer_size, size_t alignment) {
+	pool_t *pool = malloc(sizeof(pool_t));
+	if (pool == NULL)
+		return NULL;
+
+	pool->buffer_size = buffer_size;
+	pool->alignment = alignment;
+	pool->free = mx_vector_create(sizeof(void *));
+	pthread_mutex_init(&pool->mutex, NULL);
+	pool->is_huge = false;
+	pool->backing = POOL_HEAP;
+	pool->slabs = mx_vector_create(sizeof(slab_t));
+	pool->carved = 0;
+
+	return pool;
+}
+
+pool_t *pool_create_huge(size_t buffer_size, size_t alignment) {
+	pool_t *pool = pool_create(buffer_size, alignment);
+	if (pool != NULL)
+		pool->is_huge = true;
+	return pool;
+}
+
+void pool_delete(pool_t *pool) {
+	// buffers carved from slabs go with their slabs
+	if (!pool->is_huge) {
+		for (size_t i = 0; i < mx_vector_length(pool->free); i++)
+			free(pool->free[i]);
+	}
+	for (size_t i = 0; i < mx_vector_length(pool->slabs); i++)
+		munmap(pool->slabs[i].base, pool->slabs[i].size);
+	mx_vector_delete(pool->slabs);
+	mx_vector_delete(pool->free);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool);
+}
+
+size_t pool_buffer_size(pool_t *pool) {
+	return pool->buffer_size;
+}
+
+size_t pool_alignment(pool_t *pool) {
+	return pool->alignment;
+}
+
+pool_backing_t pool_backing(pool_t *pool) {
+	pthread_mutex_lock(&pool->mutex);
+	pool_backing_t backing = pool->backing;
+	pthread_mutex_unlock(&pool->mutex);
+	return backing;
+}
+
+/**
+ * Map a slab of @a size bytes, a multiple of the huge page size, from reserved
+ * huge pages if there are any, otherwise aligned to a huge page and advised
+ * for transparent huge pages, otherwise from plain pages
+ */
+static bool map_slab(pool_t *pool, size_t size, slab_t *slab) {
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+	if (base != MAP_FAILED) {
+		*slab = (slab_t) { .base = base, .size = size };
+		pool->backing = POOL_HUGETLB;
+		return true;
+	}
+
+	// over-map then trim to a huge page boundary so the kernel can back the
+	// slab with whole huge pages
+	char *mapped = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, flags,
+		-1, 0);
+	if (mapped == MAP_FAILED) {
+		fprintf(stderr, "mmap() failed for a buffer slab: %s\n", strerror(errno));
+		return false;
+	}
+	base = (char *) (((uintptr_t) mapped + HUGE_PAGE_SIZE - 1) &
+		~(uintptr_t) (HUGE_PAGE_SIZE - 1));
+	if (base > mapped)
+		munmap(mapped, base - mapped);
+	if (base + size < mapped + size + HUGE_PAGE_SIZE)
+		munmap(base + size, mapped + HUGE_PAGE_SIZE - base);
+
+	*slab = (slab_t) { .base = base, .size = size };
+	pool->backing = madvise(base, size, MADV_HUGEPAGE) == 0 ? POOL_THP : POOL_PAGES;
+	return true;
+}
+
+/// Carve a buffer from the latest slab of a huge @a pool or from a new slab
+static void *carve(pool_t *pool) {
+	size_t stride = (pool->buffer_size + pool->alignment - 1) / pool->alignment *
+		pool->alignment;
+
+	pthread_mutex_lock(&pool->mutex);
+	size_t slabs_length = mx_vector_length(pool->slabs);
+	if (slabs_length == 0 || pool->carved + stride > pool->slabs[slabs_length - 1].size) {
+		size_t size = (stride + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+		slab_t slab;
+		if (!map_slab(pool, size, &slab)) {
+			pthread_mutex_unlock(&pool->mutex);
+			return NULL;
+		}
+		slab_t *slabs = mx_vector_append(pool->slabs, &slab);
+		if (slabs == NULL) {
+			munmap(slab.base, slab.size);
+			pthread_mutex_unlock(&pool->mutex);
+			return NULL;
+		}
+		pool->slabs = slabs;
+		pool->carved = 0;
+		slabs_length++;
+	}
+
+	void *buffer = pool->slabs[slabs_length - 1].base + pool->carved;
+	pool->carved += stride;
+	pthread_mutex_unlock(&pool->mutex);
+	return buffer;
+}
+
+void *pool_acquire(pool_t *pool) {
+	void *buffer = NULL;
+
+	pthread_mutex_lock(&pool->mutex);
+	if (mx_vector_length(pool->free) > 0)
+		pool->free = mx_vector_pull(pool->free, &buffer);
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (buffer != NULL)
+		return buffer;
+
+	// map_slab() already fell back as far as plain pages
+	if (pool->is_huge) {
+		if ((buffer = carve(pool)) == NULL)
+			exit(1);
+		return buffer;
+	}
+
+	int error = posix_memalign(&buffer, pool->alignment, pool->buffer_size);
+	if (error == 0)
+		return buffer;
+	fprintf(stderr, "posix_memalign() failed: %s\n", strerror(error));
+	exit(1);
+}
+
+void pool_release(pool_t *pool, void *buffer) {
+	pthread_mutex_lock(&pool->mutex);
+	void **appended = mx_vector_append(pool->free, &buffer);
+	if (appended != NULL)
+		pool->free = appended;
+	pthread_mutex_unlock(&pool->mutex);
+
+	// a carved buffer stays mapped until the pool is deleted
+	if (appended == NULL && !pool->is_huge)
+		free(buffer);
+}
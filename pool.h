@@ -0,0 +1,60 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+typedef struct _pool_t pool_t;
+
+/// The memory behind the buffers of a pool
+typedef enum _pool_backing_t
+{
+	POOL_HEAP,    // posix_memalign()
+	POOL_HUGETLB, // reserved huge pages (MAP_HUGETLB)
+	POOL_THP,     // transparent huge pages (MADV_HUGEPAGE)
+	POOL_PAGES,   // plain pages, where neither kind of huge page is available
+} pool_backing_t;
+
+/**
+ * @brief Allocate and initialize a pool of buffers of @a buffer_size bytes
+ *        aligned to @a alignment bytes
+ *
+ * @a alignment must be a power of two. Buffers are allocated on demand and kept
+ * for reuse once released, so the pool only grows to the peak number of
+ * buffers in use at once.
+ *
+ * @return the pool on success; otherwise NULL
+ */
+pool_t *pool_create(size_t buffer_size, size_t alignment);
+
+/**
+ * @brief Like pool_create() but buffers are carved from slabs of 2 MiB huge
+ *        pages so large buffers cost few TLB entries
+ *
+ * Slabs come from reserved huge pages (MAP_HUGETLB) if there are any,
+ * otherwise from memory aligned to 2 MiB and advised for transparent huge
+ * pages, otherwise from plain pages. Slabs are only unmapped when the pool is
+ * deleted.
+ *
+ * @return the pool on success; otherwise NULL
+ */
+pool_t *pool_create_huge(size_t buffer_size, size_t alignment);
+
+/// Deallocate the @a pool and every buffer released to it
+void pool_delete(pool_t *pool);
+
+/// Return the size of the buffers in the @a pool
+size_t pool_buffer_size(pool_t *pool);
+
+/// Return the alignment of the buffers in the @a pool
+size_t pool_alignment(pool_t *pool);
+
+/// Return the memory behind the latest buffers of the @a pool
+pool_backing_t pool_backing(pool_t *pool);
+
+/// Take a buffer from the @a pool or exit if none can be allocated
+void *pool_acquire(pool_t *pool);
+
+/// Return the @a buffer to the @a pool for reuse
+void pool_release(pool_t *pool, void *buffer);
+
+#endif /* POOL_H */
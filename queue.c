@@ -0,0 +1,84 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "queue.h"
+
+struct _queue_t
+{
+	size_t volume;
+	size_t element_size;
+	size_t producers; // producers that haven't closed the queue yet
+	size_t head;      // the slot of the oldest element
+	size_t length;
+	char *elements;   // a ring of volume slots
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+queue_t *queue_create(size_t volume, size_t element_size, size_t producers) {
+	queue_t *queue = malloc(sizeof(queue_t));
+	if (queue == NULL)
+		return NULL;
+
+	queue->volume = volume == 0 ? 1 : volume;
+	queue->element_size = element_size;
+	queue->producers = producers;
+	queue->head = 0;
+	queue->length = 0;
+	if ((queue->elements = malloc(queue->volume * element_size)) == NULL) {
+		free(queue);
+		return NULL;
+	}
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_cond_init(&queue->cond, NULL);
+
+	return queue;
+}
+
+void queue_delete(queue_t *queue) {
+	pthread_cond_destroy(&queue->cond);
+	pthread_mutex_destroy(&queue->mutex);
+	free(queue->elements);
+	free(queue);
+}
+
+void queue_push(queue_t *queue, const void *elmt) {
+	pthread_mutex_lock(&queue->mutex);
+	while (queue->length == queue->volume)
+		pthread_cond_wait(&queue->cond, &queue->mutex);
+
+	size_t slot = (queue->head + queue->length) % queue->volume;
+	memcpy(queue->elements + slot * queue->element_size, elmt, queue->element_size);
+	queue->length++;
+
+	// producers and consumers share the condition so wake them all
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+bool queue_pop(queue_t *queue, void *elmt) {
+	pthread_mutex_lock(&queue->mutex);
+	while (queue->length == 0 && queue->producers > 0)
+		pthread_cond_wait(&queue->cond, &queue->mutex);
+
+	bool result = queue->length > 0;
+	if (result) {
+		memcpy(elmt, queue->elements + queue->head * queue->element_size,
+			queue->element_size);
+		queue->head = (queue->head + 1) % queue->volume;
+		queue->length--;
+		pthread_cond_broadcast(&queue->cond);
+	}
+
+	pthread_mutex_unlock(&queue->mutex);
+	return result;
+}
+
+void queue_close(queue_t *queue) {
+	pthread_mutex_lock(&queue->mutex);
+	queue->producers--;
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->mutex);
+}
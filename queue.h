@@ -0,0 +1,38 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct _queue_t queue_t;
+
+/**
+ * @brief Allocate and initialize a queue of at most @a volume elements of
+ *        @a element_size bytes fed by @a producers producers
+ *
+ * The queue is closed once each producer has called queue_close(), after which
+ * queue_pop() drains it then fails.
+ *
+ * @return the queue on success; otherwise NULL
+ */
+queue_t *queue_create(size_t volume, size_t element_size, size_t producers);
+
+/// Deallocate the @a queue
+void queue_delete(queue_t *queue);
+
+/// Copy the element at @a elmt into the @a queue, waiting while it is full
+void queue_push(queue_t *queue, const void *elmt);
+
+/**
+ * @brief Move the oldest element of the @a queue to @a elmt, waiting while it
+ *        is empty
+ *
+ * @return whether there was an element; false once the queue is closed and
+ *         empty
+ */
+bool queue_pop(queue_t *queue, void *elmt);
+
+/// Mark that one producer of the @a queue is done
+void queue_close(queue_t *queue);
+
+#endif /* QUEUE_H */
@@ -0,0 +1,987 @@
+#define _GNU_SOURCE
+#include <aio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "mx/common.h"
+#include "mx/map.h"
+#include "affinity.h"
+#include "blockcache.h"
+#include "device.h"
+#include "fdcache.h"
+#include "pool.h"
+#include "reader.h"
+
+/// Buffers are page aligned which satisfies any logical block size up to 4 KiB
+#define BUFFER_ALIGNMENT 4096
+
+reader_config_t reader_config = {
+	.is_direct = false,
+	.cache_pages = 0,
+	.prefetch_size = 1 << 20,
+	.buffer_size = 65536,
+	.is_huge = false,
+	.fd_cache_size = 0,
+	.block_cache_size = 0,
+	.sample_count = 8,
+	.sample_size = 4096,
+	.range_threads = 0,
+	.range_size = 16 << 20,
+};
+
+static pool_t **pools; // a pool per NUMA node so buffers stay local to readers
+static size_t pools_length;
+static fdcache_t *fdcache;
+static blockcache_t *blockcache;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_once_t fdcache_once = PTHREAD_ONCE_INIT;
+
+/// Buffers for the samples of a file and the slack of an unaligned last block
+static pool_t *sample_pool;
+static pthread_key_t sampler_key;
+
+/// Bytes read by this worker that are still in the page cache (if managed)
+static __thread off_t resident;
+
+static mx_map_t block_sizes; // dev_t -> size_t logical block size
+static pthread_mutex_t block_sizes_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static mx_map_t samples; // size_t file id -> uint64_t sample digest
+static size_t samples_compared;
+static size_t samples_eliminated;
+static pthread_mutex_t samples_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t verified_bytes; // bytes read by is_same_files()
+static pthread_mutex_t verified_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t splits_compared;  // compares split into ranges
+static size_t splits_cancelled; // of those, the ones cut short by a difference
+static pthread_mutex_t splits_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/// The splits being compared, which the range helpers take ranges of
+static struct _split_t *posted;
+static pthread_mutex_t helpers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t split_posted = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t split_left = PTHREAD_COND_INITIALIZER; // a helper left a split
+static pthread_once_t helpers_once = PTHREAD_ONCE_INIT;
+
+/// A run of a file that is either all data or all hole
+typedef struct _region_t
+{
+	off_t end;
+	bool is_hole;
+} region_t;
+
+/// An open file and the alignment its reads need while O_DIRECT is in effect
+typedef struct _handle_t
+{
+	int fd;
+	size_t id; // the id in the descriptor cache or MX_ABSENT
+	char *name;
+	dev_t dev;
+	off_t size;
+	size_t alignment; // zero once reads are buffered
+	off_t dropped;    // the page cache before this was released
+	off_t cursor;     // the end of the furthest read
+	off_t prefetched; // the end of the last prefetch hint
+} handle_t;
+
+/// A compare of two files split into ranges that several threads take
+typedef struct _split_t
+{
+	char *name_1;
+	char *name_2;
+	dev_t dev_1;
+	dev_t dev_2;
+	off_t size;
+	atomic_size_t next;       // the index of the next range to take
+	atomic_bool is_different; // set once any range differs or fails
+	size_t helpers;           // the helpers working on it
+	bool is_skipped;          // set once a helper can't open the files or
+	                          // take a read slot on their devices
+	struct _split_t *next_posted;
+} split_t;
+
+/// The buffer and read requests a thread samples files with
+typedef struct _sampler_t
+{
+	unsigned char *buffer; // a buffer of sample_pool
+	struct aiocb *blocks;
+	struct aiocb **list;
+} sampler_t;
+
+static size_t sample_size(void);
+static void release_sampler(void *data);
+
+/// Create the descriptor cache, which only readers of files by id use
+static void create_fdcache(void) {
+	int flags = reader_config.is_direct ? O_DIRECT : 0;
+	if ((fdcache = fdcache_create(reader_config.fd_cache_size, flags)) == NULL)
+		abort();
+}
+
+static void create_pool(void) {
+	// O_DIRECT reads need whole blocks so round the buffers up to the alignment
+	size_t size = MX_MAXIMUM(reader_config.buffer_size, (size_t) 1);
+	size = (size + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+	pools_length = affinity_nodes();
+	if ((pools = malloc(pools_length * sizeof(pool_t *))) == NULL)
+		abort();
+	for (size_t i = 0; i < pools_length; i++) {
+		pools[i] = reader_config.is_huge ? pool_create_huge(size, BUFFER_ALIGNMENT) :
+			pool_create(size, BUFFER_ALIGNMENT);
+		if (pools[i] == NULL)
+			abort();
+	}
+	if (reader_config.block_cache_size != 0 &&
+			(blockcache = blockcache_create(reader_config.block_cache_size, size)) == NULL)
+		abort();
+	block_sizes = mx_map_create(sizeof(dev_t), sizeof(size_t), NULL, NULL);
+	samples = mx_map_create(sizeof(size_t), sizeof(uint64_t), NULL, NULL);
+
+	size_t samples_size = MX_MAXIMUM(reader_config.sample_count, (size_t) 1) *
+		sample_size() + BUFFER_ALIGNMENT;
+	if ((sample_pool = pool_create(samples_size, BUFFER_ALIGNMENT)) == NULL)
+		abort();
+	if (pthread_key_create(&sampler_key, release_sampler) != 0)
+		abort();
+}
+
+/**
+ * Return the pool of the NUMA node the calling thread runs on. Buffers are
+ * placed on the node that first fills them, so a buffer taken from the local
+ * pool stays local. A thread that moves between acquiring and releasing a
+ * buffer only hands it to another node's pool.
+ */
+static pool_t *local_pool(void) {
+	size_t node = affinity_node();
+	return pools[node < pools_length ? node : 0];
+}
+
+/**
+ * Return the logical block size of the device @a dev from sysfs. Partitions
+ * keep their queue attributes on the parent device. Devices without a block
+ * queue (such as those of network and FUSE filesystems) default to 4 KiB.
+ */
+static size_t logical_block_size(dev_t dev) {
+	pthread_mutex_lock(&block_sizes_mutex);
+	size_t *cached = mx_map_get(block_sizes, &dev);
+	size_t result = cached == NULL ? 0 : *cached;
+	pthread_mutex_unlock(&block_sizes_mutex);
+	if (result != 0)
+		return result;
+
+	char *formats[] = {
+		"/sys/dev/block/%u:%u/queue/logical_block_size",
+		"/sys/dev/block/%u:%u/../queue/logical_block_size",
+	};
+	for (size_t i = 0; result == 0 && i < sizeof(formats) / sizeof(*formats); i++) {
+		char path[128];
+		snprintf(path, sizeof(path), formats[i], major(dev), minor(dev));
+		FILE *file = fopen(path, "r");
+		if (file == NULL)
+			continue;
+		if (fscanf(file, "%zu", &result) != 1)
+			result = 0;
+		fclose(file);
+	}
+	if (result == 0)
+		result = 4096;
+
+	pthread_mutex_lock(&block_sizes_mutex);
+	mx_map_put(block_sizes, &dev, &result);
+	pthread_mutex_unlock(&block_sizes_mutex);
+	return result;
+}
+
+/// Release the page cache of @a handle behind its cursor
+static void drop_behind(handle_t *handle);
+
+static void close_handle(handle_t *handle) {
+	// a file is only closed once it has been hashed or compared
+	if (reader_config.cache_pages != 0)
+		drop_behind(handle);
+	if (handle->id != MX_ABSENT)
+		fdcache_release(fdcache, handle->id);
+	else
+		close(handle->fd);
+}
+
+/// Stop using O_DIRECT for the reads of @a handle
+static void use_buffered(handle_t *handle) {
+	int flags = fcntl(handle->fd, F_GETFL);
+	if (flags >= 0)
+		fcntl(handle->fd, F_SETFL, flags & ~O_DIRECT);
+	handle->alignment = 0;
+}
+
+/**
+ * Open the file at @a name into @a handle, with O_DIRECT if configured. If the
+ * filesystem refuses O_DIRECT or the device needs a larger alignment than the
+ * pool buffers have then the file is read buffered instead.
+ *
+ * Unless @a id is MX_ABSENT the descriptor comes from the descriptor cache
+ * under @a id and stays open after close_handle() for the next reader.
+ */
+static bool open_handle(handle_t *handle, size_t id, char *name) {
+	pthread_once(&pool_once, create_pool);
+
+	handle->id = id;
+	handle->name = name;
+	handle->alignment = 0;
+	handle->fd = -1;
+	handle->dropped = 0;
+	handle->cursor = 0;
+	handle->prefetched = 0;
+
+	if (id != MX_ABSENT) {
+		pthread_once(&fdcache_once, create_fdcache);
+		handle->fd = fdcache_acquire(fdcache, id, name);
+	}
+	else {
+		if (reader_config.is_direct)
+			handle->fd = open(name, O_RDONLY | O_CLOEXEC | O_DIRECT);
+		if (handle->fd < 0)
+			handle->fd = open(name, O_RDONLY | O_CLOEXEC);
+	}
+	if (handle->fd < 0) {
+		fprintf(stderr, "open() failed on %s: %s\n", name, strerror(errno));
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(handle->fd, &st) != 0) {
+		fprintf(stderr, "fstat() failed on %s: %s\n", name, strerror(errno));
+		close_handle(handle);
+		return false;
+	}
+	handle->dev = st.st_dev;
+	handle->size = st.st_size;
+
+	int flags = fcntl(handle->fd, F_GETFL);
+	if (flags >= 0 && (flags & O_DIRECT)) {
+		handle->alignment = logical_block_size(st.st_dev);
+		if (BUFFER_ALIGNMENT % handle->alignment != 0)
+			use_buffered(handle);
+	}
+
+	if (reader_config.cache_pages != 0)
+		posix_fadvise(handle->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	return true;
+}
+
+static void drop_behind(handle_t *handle) {
+	if (handle->cursor <= handle->dropped)
+		return;
+	posix_fadvise(handle->fd, handle->dropped, handle->cursor - handle->dropped,
+		POSIX_FADV_DONTNEED);
+	resident -= handle->cursor - handle->dropped;
+	handle->dropped = handle->cursor;
+}
+
+/**
+ * Account for a buffered read of @a handle that ended at @a end. Prefetch is
+ * hinted a window ahead of the cursor, and once the pages this worker has read
+ * exceed the cap the pages behind the cursor are released.
+ */
+static void advise_read(handle_t *handle, off_t end) {
+	if (reader_config.cache_pages == 0 || handle->alignment != 0)
+		return;
+
+	if (end > handle->cursor) {
+		resident += end - handle->cursor;
+		handle->cursor = end;
+	}
+
+	off_t window = end + reader_config.prefetch_size;
+	if (handle->prefetched < window && window - handle->prefetched >=
+			(off_t) reader_config.prefetch_size / 2) {
+		off_t start = MX_MAXIMUM(handle->prefetched, end);
+		posix_fadvise(handle->fd, start, window - start, POSIX_FADV_WILLNEED);
+		handle->prefetched = window;
+	}
+
+	if (resident > (off_t) reader_config.cache_pages * sysconf(_SC_PAGESIZE))
+		drop_behind(handle);
+}
+
+
+/**
+ * Find the region of @a fd starting at @a offset. Filesystems without
+ * SEEK_DATA support report the whole file as data so they need no special
+ * handling; any other failure is also treated as data.
+ */
+static region_t find_region(int fd, off_t offset, off_t size) {
+	off_t data = lseek(fd, offset, SEEK_DATA);
+	if (data < 0)
+		return (region_t) { .end = size, .is_hole = errno == ENXIO };
+	if (data > offset)
+		return (region_t) { .end = MX_MINIMUM(data, size), .is_hole = true };
+
+	off_t hole = lseek(fd, offset, SEEK_HOLE);
+	if (hole < 0 || hole > size)
+		hole = size;
+	return (region_t) { .end = hole, .is_hole = false };
+}
+
+static bool is_zero(unsigned char *buffer, size_t size) {
+	return size == 0 || (buffer[0] == 0 && memcmp(buffer, buffer + 1, size - 1) == 0);
+}
+
+/**
+ * Read exactly @a size bytes at @a offset from @a handle into @a buffer, which
+ * must be a pool buffer. A short read means the file shrank.
+ *
+ * Under O_DIRECT the read is rounded up to the logical block size; the extra
+ * bytes past the end of file are never returned by the kernel. An unaligned
+ * offset (the tail after a short read) or an EINVAL from the filesystem
+ * switches the handle to buffered reads for the rest of the file.
+ */
+static bool read_at(handle_t *handle, unsigned char *buffer, size_t size, off_t offset) {
+	size_t done = 0;
+
+	while (done < size) {
+		size_t want = size - done;
+		if (handle->alignment != 0) {
+			if ((offset + done) % handle->alignment != 0) {
+				use_buffered(handle);
+				continue;
+			}
+			want = (want + handle->alignment - 1) / handle->alignment * handle->alignment;
+		}
+
+		ssize_t count = pread(handle->fd, buffer + done, want, offset + done);
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count < 0 && errno == EINVAL && handle->alignment != 0) {
+			use_buffered(handle);
+			continue;
+		}
+		if (count <= 0)
+			return false;
+		done += count;
+	}
+
+	advise_read(handle, offset + size);
+	return true;
+}
+
+/**
+ * Like read_at() but through the block cache when @a handle has an id and the
+ * read starts on a block boundary. Only whole blocks (or the final block of
+ * the file) are cached; reads cut short by a hole boundary bypass the cache.
+ */
+static bool read_block(handle_t *handle, unsigned char *buffer, size_t size, off_t offset) {
+	size_t block_size = pool_buffer_size(pools[0]);
+	if (blockcache == NULL || handle->id == MX_ABSENT || offset % block_size != 0)
+		return read_at(handle, buffer, size, offset);
+
+	size_t index = offset / block_size;
+	size_t length;
+	if (blockcache_get(blockcache, handle->id, index, buffer, &length) &&
+			length >= size)
+		return true;
+
+	if (!read_at(handle, buffer, size, offset))
+		return false;
+	if (size == MX_MINIMUM(block_size, (size_t) (handle->size - offset)))
+		blockcache_put(blockcache, handle->id, index, buffer, size);
+	return true;
+}
+
+/// Return the sampled block size, rounded up so that O_DIRECT can read it
+static size_t sample_size(void) {
+	size_t size = MX_MAXIMUM(reader_config.sample_size, (size_t) 1);
+	return (size + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+}
+
+/// The buffer and read requests of this thread's samples
+static __thread sampler_t *sampler;
+
+/// Give the sample buffer of a thread that exited back to the sample pool
+static void release_sampler(void *data) {
+	sampler_t *released = data;
+	pool_release(sample_pool, released->buffer);
+	free(released->list);
+	free(released->blocks);
+	free(released);
+}
+
+/// Return this thread's sampler, taking its buffer from the sample pool once
+static sampler_t *local_sampler(void) {
+	if (sampler != NULL)
+		return sampler;
+
+	size_t count = reader_config.sample_count;
+	if ((sampler = malloc(sizeof(sampler_t))) == NULL)
+		abort();
+	sampler->buffer = pool_acquire(sample_pool);
+	sampler->blocks = calloc(count, sizeof(struct aiocb));
+	sampler->list = malloc(count * sizeof(struct aiocb *));
+	if (sampler->blocks == NULL || sampler->list == NULL)
+		abort();
+	pthread_setspecific(sampler_key, sampler);
+	return sampler;
+}
+
+/**
+ * Hash the blocks sampled from @a handle into @a digest. The reads are
+ * submitted together with lio_listio() so that they are all in flight at once
+ * instead of each waiting out the seek of the one before. glibc serves them
+ * from its pool of AIO threads, so this holds as long as the pool, 20 threads
+ * by default, isn't busy with other samples. Blocks the
+ * asynchronous read failed or cut short are read again with read_at(), which
+ * handles the O_DIRECT fallbacks.
+ *
+ * The first block is at the start and the last one ends exactly at the end of
+ * the file; the rest are spread evenly between them on aligned offsets. Under
+ * O_DIRECT an unaligned last block is read as the aligned range that covers it
+ * up to the end of the file, so the descriptor stays direct.
+ */
+static bool sample_digest(handle_t *handle, uint64_t *digest) {
+	size_t count = reader_config.sample_count;
+	size_t size = sample_size();
+	sampler_t *local = local_sampler();
+	struct aiocb *blocks = local->blocks;
+	off_t last = handle->size - size;
+
+	for (size_t k = 0; k < count; k++) {
+		off_t offset;
+		size_t length = size;
+		if (count == 1)
+			offset = 0;
+		else if (k + 1 < count)
+			offset = last / (off_t) (count - 1) * (off_t) k / BUFFER_ALIGNMENT *
+				BUFFER_ALIGNMENT;
+		else if (handle->alignment == 0)
+			offset = last; // buffered reads take any offset
+		else {
+			offset = last / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+			length = handle->size - offset;
+		}
+
+		memset(&blocks[k], 0, sizeof(struct aiocb));
+		blocks[k].aio_fildes = handle->fd;
+		blocks[k].aio_buf = local->buffer + k * size;
+		blocks[k].aio_nbytes = (length + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT *
+			BUFFER_ALIGNMENT;
+		blocks[k].aio_offset = offset;
+		blocks[k].aio_lio_opcode = LIO_READ;
+		local->list[k] = &blocks[k];
+	}
+
+	// a failed block is reported by its aio_error() so the result is not needed
+	lio_listio(LIO_WAIT, local->list, count, NULL);
+
+	bool result = true;
+	*digest = MX_FNV1A_BASIS;
+	for (size_t k = 0; result && k < count; k++) {
+		unsigned char *block = local->buffer + k * size;
+		size_t length = MX_MINIMUM((off_t) blocks[k].aio_nbytes,
+			handle->size - blocks[k].aio_offset);
+		if (aio_error(&blocks[k]) != 0 || aio_return(&blocks[k]) != (ssize_t) length)
+			result = read_at(handle, block, length, blocks[k].aio_offset);
+
+		// hash the size bytes that end the block; only the last one is longer
+		if (result)
+			*digest = mx_fnv1a_extend(*digest, (char *) block + length - size, size);
+	}
+
+	return result;
+}
+
+/**
+ * Return the sample digest of @a handle in @a digest, from the cache of sample
+ * digests if it has an id.
+ */
+static bool find_sample(handle_t *handle, uint64_t *digest) {
+	if (handle->id != MX_ABSENT) {
+		pthread_mutex_lock(&samples_mutex);
+		uint64_t *cached = mx_map_get(samples, &handle->id);
+		if (cached != NULL)
+			*digest = *cached;
+		pthread_mutex_unlock(&samples_mutex);
+		if (cached != NULL)
+			return true;
+	}
+
+	if (!sample_digest(handle, digest))
+		return false;
+
+	if (handle->id != MX_ABSENT) {
+		pthread_mutex_lock(&samples_mutex);
+		if (mx_map_put(samples, &handle->id, digest) == NULL)
+			abort();
+		pthread_mutex_unlock(&samples_mutex);
+	}
+	return true;
+}
+
+/**
+ * Return whether the samples of two files of the same size leave them possibly
+ * equal. Small files, and files that can't be sampled, always may be.
+ */
+static bool is_sample_match(handle_t *handle_1, handle_t *handle_2) {
+	size_t count = reader_config.sample_count;
+	if (count == 0 || handle_1->size < (off_t) (SAMPLE_SPREAD * count * sample_size()))
+		return true;
+
+	uint64_t digest_1, digest_2;
+	if (!find_sample(handle_1, &digest_1) || !find_sample(handle_2, &digest_2))
+		return true;
+
+	bool result = digest_1 == digest_2;
+	pthread_mutex_lock(&samples_mutex);
+	samples_compared++;
+	if (!result)
+		samples_eliminated++;
+	pthread_mutex_unlock(&samples_mutex);
+	return result;
+}
+
+bool is_same_file(char *name_1, char *name_2) {
+	return is_same_file_id(MX_ABSENT, name_1, MX_ABSENT, name_2);
+}
+
+/**
+ * Return whether @a handle_1 and @a handle_2 have the same content from
+ * @a offset to @a end. Both files are walked region by region; a hole in both
+ * is skipped unread and a hole in one only needs the other to read as zeros.
+ * The walk stops early once @a is_different is set, if given.
+ */
+static bool compare_range(handle_t *handle_1, handle_t *handle_2, off_t offset,
+		off_t end, atomic_bool *is_different) {
+	unsigned char *buffer_1 = pool_acquire(local_pool());
+	unsigned char *buffer_2 = pool_acquire(local_pool());
+	off_t size = handle_1->size;
+	region_t region_1 = { .end = 0 }, region_2 = { .end = 0 };
+	bool result = true;
+
+	while (result && offset < end) {
+		if (is_different != NULL && atomic_load(is_different))
+			break;
+		if (offset >= region_1.end)
+			region_1 = find_region(handle_1->fd, offset, size);
+		if (offset >= region_2.end)
+			region_2 = find_region(handle_2->fd, offset, size);
+
+		off_t stop = MX_MINIMUM(MX_MINIMUM(region_1.end, region_2.end), end);
+		if (region_1.is_hole && region_2.is_hole) {
+			offset = stop;
+			continue;
+		}
+
+		size_t count = MX_MINIMUM(stop - offset, (off_t) pool_buffer_size(pools[0]));
+		if (region_1.is_hole)
+			result = read_block(handle_2, buffer_2, count, offset) &&
+				is_zero(buffer_2, count);
+		else if (region_2.is_hole)
+			result = read_block(handle_1, buffer_1, count, offset) &&
+				is_zero(buffer_1, count);
+		else
+			result = read_block(handle_1, buffer_1, count, offset) &&
+				read_block(handle_2, buffer_2, count, offset) &&
+				memcmp(buffer_1, buffer_2, count) == 0;
+		offset += count;
+	}
+
+	pool_release(local_pool(), buffer_1);
+	pool_release(local_pool(), buffer_2);
+	return result;
+}
+
+/**
+ * Compare the ranges of @a split with @a handle_1 and @a handle_2 until none
+ * are left or one of them differs
+ */
+static void compare_ranges(split_t *split, handle_t *handle_1, handle_t *handle_2) {
+	off_t range = reader_config.range_size;
+
+	while (!atomic_load(&split->is_different)) {
+		off_t offset = atomic_fetch_add(&split->next, 1) * range;
+		if (offset >= split->size)
+			break;
+		off_t end = MX_MINIMUM(offset + range, split->size);
+		if (!compare_range(handle_1, handle_2, offset, end, &split->is_different))
+			atomic_store(&split->is_different, true);
+	}
+}
+
+/// Return whether @a split has ranges left that a helper may take
+static bool has_ranges(split_t *split) {
+	return !split->is_skipped && !atomic_load(&split->is_different) &&
+		(off_t) atomic_load(&split->next) * (off_t) reader_config.range_size < split->size;
+}
+
+/**
+ * Help with the posted splits. A helper reads in a read slot of the files'
+ * devices like any reader (see device_try_enter()), so a device limited to
+ * one reader, whose slot the posting thread holds, isn't read by helpers.
+ * Once a helper can't take the slots or open the files of a split the
+ * helpers leave its ranges to the thread that posted it.
+ */
+static void *split_main(void *data) {
+	(void) data;
+
+	// the helpers serve every worker, not just the pinned one that started them
+	affinity_unpin();
+
+	pthread_mutex_lock(&helpers_mutex);
+	for (;;) {
+		split_t *split = posted;
+		while (split != NULL && !has_ranges(split))
+			split = split->next_posted;
+		if (split == NULL) {
+			pthread_cond_wait(&split_posted, &helpers_mutex);
+			continue;
+		}
+		split->helpers++;
+		pthread_mutex_unlock(&helpers_mutex);
+
+		// descriptors are shared between threads but handles aren't
+		handle_t handle_1, handle_2;
+		bool is_opened = false;
+		if (device_try_enter(split->dev_1, split->dev_2)) {
+			if (open_handle(&handle_1, MX_ABSENT, split->name_1)) {
+				if ((is_opened = open_handle(&handle_2, MX_ABSENT, split->name_2))) {
+					compare_ranges(split, &handle_1, &handle_2);
+					close_handle(&handle_2);
+				}
+				close_handle(&handle_1);
+			}
+			device_leave(split->dev_1, split->dev_2);
+		}
+
+		pthread_mutex_lock(&helpers_mutex);
+		if (!is_opened)
+			split->is_skipped = true;
+		if (--split->helpers == 0)
+			pthread_cond_broadcast(&split_left);
+	}
+	return NULL;
+}
+
+/// Start the range_threads - 1 helpers that every split compare shares
+static void create_helpers(void) {
+	for (size_t t = 0; t + 1 < reader_config.range_threads; t++) {
+		pthread_t id;
+		int error = pthread_create(&id, NULL, split_main, NULL);
+		if (error != 0) {
+			// the compares go on with the helpers there are
+			fprintf(stderr, "pthread_create() failed for a range helper: %s\n",
+				strerror(error));
+			break;
+		}
+		pthread_detach(id);
+	}
+}
+
+/**
+ * Compare @a handle_1 and @a handle_2 in ranges of range_size bytes taken by
+ * this thread and the idle helpers; every range stops as soon as any of them
+ * finds a difference
+ */
+static bool compare_split(handle_t *handle_1, handle_t *handle_2) {
+	split_t split = {
+		.name_1 = handle_1->name,
+		.name_2 = handle_2->name,
+		.dev_1 = handle_1->dev,
+		.dev_2 = handle_2->dev,
+		.size = handle_1->size,
+		.helpers = 0,
+		.is_skipped = false,
+	};
+	atomic_init(&split.next, 0);
+	atomic_init(&split.is_different, false);
+
+	pthread_once(&helpers_once, create_helpers);
+	pthread_mutex_lock(&helpers_mutex);
+	split.next_posted = posted;
+	posted = &split;
+	pthread_cond_broadcast(&split_posted);
+	pthread_mutex_unlock(&helpers_mutex);
+
+	compare_ranges(&split, handle_1, handle_2);
+
+	// withdraw the split so no helper joins late and wait for those still in it
+	pthread_mutex_lock(&helpers_mutex);
+	split_t **link = &posted;
+	while (*link != &split)
+		link = &(*link)->next_posted;
+	*link = split.next_posted;
+	while (split.helpers > 0)
+		pthread_cond_wait(&split_left, &helpers_mutex);
+	pthread_mutex_unlock(&helpers_mutex);
+
+	pthread_mutex_lock(&splits_mutex);
+	splits_compared++;
+	splits_cancelled += atomic_load(&split.is_different);
+	pthread_mutex_unlock(&splits_mutex);
+	return !atomic_load(&split.is_different);
+}
+
+bool is_same_file_id(size_t id_1, char *name_1, size_t id_2, char *name_2) {
+	handle_t handle_1, handle_2;
+	if (!open_handle(&handle_1, id_1, name_1) ||
+			!open_handle(&handle_2, id_2, name_2))
+		exit(1);
+
+	bool result;
+	if (handle_1.size != handle_2.size || !is_sample_match(&handle_1, &handle_2))
+		result = false;
+	else if (reader_config.range_threads > 1 && reader_config.range_size != 0 &&
+			handle_1.size > (off_t) reader_config.range_size)
+		result = compare_split(&handle_1, &handle_2);
+	else
+		result = compare_range(&handle_1, &handle_2, 0, handle_1.size, NULL);
+
+	close_handle(&handle_1);
+	close_handle(&handle_2);
+	return result;
+}
+
+/// Move file @a i to a class of its own; the rest of its class stays together
+static void isolate(size_t *classes, size_t length, size_t i) {
+	size_t least = MX_ABSENT;
+	for (size_t j = 0; j < length; j++) {
+		if (j == i || classes[j] != classes[i])
+			continue;
+		if (least == MX_ABSENT)
+			least = j;
+		classes[j] = least;
+	}
+	classes[i] = i;
+}
+
+/// Give every file of a class of one its own class and return the live files
+static size_t settle(size_t *classes, bool *is_live, size_t length) {
+	size_t *counts = calloc(length, sizeof(size_t));
+	if (counts == NULL)
+		abort();
+	for (size_t i = 0; i < length; i++)
+		counts[classes[i]]++;
+
+	size_t live = 0;
+	for (size_t i = 0; i < length; i++) {
+		is_live[i] = is_live[i] && counts[classes[i]] >= 2;
+		live += is_live[i];
+	}
+
+	free(counts);
+	return live;
+}
+
+/// Return whether two steps of @a count bytes, each a buffer or a hole, match
+static bool is_same_step(unsigned char *buffer_1, bool is_hole_1,
+		unsigned char *buffer_2, bool is_hole_2, size_t count) {
+	if (is_hole_1 && is_hole_2)
+		return true;
+	if (is_hole_1)
+		return is_zero(buffer_2, count);
+	if (is_hole_2)
+		return is_zero(buffer_1, count);
+	return memcmp(buffer_1, buffer_2, count) == 0;
+}
+
+bool is_same_files(char **names, size_t length, size_t *classes) {
+	handle_t *handles = calloc(length, sizeof(handle_t));
+	unsigned char **buffers = calloc(length, sizeof(unsigned char *));
+	bool *is_live = calloc(length, sizeof(bool));
+	size_t *refined = calloc(length, sizeof(size_t));
+	region_t *regions = calloc(length, sizeof(region_t));
+	if (handles == NULL || buffers == NULL || is_live == NULL || refined == NULL ||
+			regions == NULL)
+		abort();
+
+	// files start in a class per size; files that can't be opened are alone
+	bool result = true;
+	for (size_t i = 0; i < length; i++) {
+		classes[i] = i;
+		if (!(is_live[i] = open_handle(&handles[i], MX_ABSENT, names[i]))) {
+			result = false;
+			continue;
+		}
+		buffers[i] = pool_acquire(local_pool());
+		for (size_t j = 0; j < i; j++) {
+			if (is_live[j] && handles[j].size == handles[i].size) {
+				classes[i] = classes[j];
+				break;
+			}
+		}
+	}
+
+	// read every live file a step at a time and split each class by content;
+	// a file whose class is down to itself isn't read any further. A step ends
+	// at the next region boundary of any live file so that within a step each
+	// file is all data or all hole, and holes are taken as zeros unread.
+	size_t block = pool_buffer_size(pools[0]);
+	size_t read = 0;
+	off_t step;
+	for (off_t offset = 0; settle(classes, is_live, length) > 0; offset += step) {
+		step = block;
+		for (size_t i = 0; i < length; i++) {
+			if (!is_live[i])
+				continue;
+			if (offset >= handles[i].size) {
+				is_live[i] = false;
+				continue;
+			}
+			if (offset >= regions[i].end)
+				regions[i] = find_region(handles[i].fd, offset, handles[i].size);
+			step = MX_MINIMUM(step, regions[i].end - offset);
+		}
+
+		for (size_t i = 0; i < length; i++) {
+			if (!is_live[i] || regions[i].is_hole)
+				continue;
+			if (!read_at(&handles[i], buffers[i], step, offset)) {
+				fprintf(stderr, "pread() failed on %s\n", names[i]);
+				isolate(classes, length, i);
+				is_live[i] = false;
+				result = false;
+				continue;
+			}
+			read += step;
+		}
+
+		// the files of a class have the same size so they share every step
+		for (size_t i = 0; i < length; i++) {
+			refined[i] = is_live[i] ? i : classes[i];
+			if (!is_live[i])
+				continue;
+			for (size_t j = 0; j < i; j++) {
+				if (is_live[j] && refined[j] == j && classes[j] == classes[i] &&
+						is_same_step(buffers[j], regions[j].is_hole, buffers[i],
+							regions[i].is_hole, step)) {
+					refined[i] = j;
+					break;
+				}
+			}
+		}
+		memcpy(classes, refined, length * sizeof(size_t));
+	}
+
+	for (size_t i = 0; i < length; i++) {
+		if (buffers[i] == NULL)
+			continue;
+		pool_release(local_pool(), buffers[i]);
+		close_handle(&handles[i]);
+	}
+	free(regions);
+	free(refined);
+	free(is_live);
+	free(buffers);
+	free(handles);
+
+	pthread_mutex_lock(&verified_mutex);
+	verified_bytes += read;
+	pthread_mutex_unlock(&verified_mutex);
+	return result;
+}
+
+bool file_scan(char *name, reader_sink_f sink, void *data) {
+	return file_scan_head(name, -1, sink, data);
+}
+
+bool file_scan_head(char *name, off_t length, reader_sink_f sink, void *data) {
+	return file_scan_range(name, 0, length, sink, data);
+}
+
+bool file_scan_range(char *name, off_t offset, off_t length, reader_sink_f sink,
+		void *data) {
+	// unlike is_same_file() a file that vanished or can't be read isn't fatal
+	handle_t handle;
+	if (!open_handle(&handle, MX_ABSENT, name))
+		return false;
+
+	unsigned char *buffer = pool_acquire(local_pool());
+	bool result = true;
+	off_t end = length < 0 ? handle.size : MX_MINIMUM(offset + length, handle.size);
+
+	// the pages before the range aren't this reader's to account for or drop
+	handle.dropped = handle.cursor = handle.prefetched = offset;
+
+	while (result && offset < end) {
+		region_t region = find_region(handle.fd, offset, end);
+
+		// holes are passed on as runs of zeros without being read
+		if (region.is_hole) {
+			sink(data, NULL, region.end - offset);
+			offset = region.end;
+			continue;
+		}
+
+		while (result && offset < region.end) {
+			size_t count = MX_MINIMUM(region.end - offset,
+				(off_t) pool_buffer_size(pools[0]));
+			if ((result = read_at(&handle, buffer, count, offset)))
+				sink(data, buffer, count);
+			offset += count;
+		}
+	}
+
+	if (!result)
+		fprintf(stderr, "pread() failed on %s\n", name);
+	pool_release(local_pool(), buffer);
+	close_handle(&handle);
+
+	return result;
+}
+
+void digest_sink(void *data, const unsigned char *buffer, size_t size) {
+	uint64_t *hash = data;
+	if (buffer == NULL)
+		*hash = mx_fnv1a_zeros(*hash, size);
+	else
+		*hash = mx_fnv1a_extend(*hash, (char *) buffer, size);
+}
+
+bool file_digest(char *name, uint64_t *digest) {
+	*digest = MX_FNV1A_BASIS;
+	return file_scan(name, digest_sink, digest);
+}
+
+void reader_print_stats(FILE *out) {
+	if (pools == NULL)
+		return;
+	if (fdcache != NULL)
+		fprintf(out, "descriptor cache: %zu hits, %zu misses\n",
+			fdcache_hits(fdcache), fdcache_misses(fdcache));
+
+	pthread_mutex_lock(&verified_mutex);
+	fprintf(out, "verification: %zu bytes read\n", verified_bytes);
+	pthread_mutex_unlock(&verified_mutex);
+
+	char *backings[] = {
+		[POOL_HEAP] = "heap",
+		[POOL_HUGETLB] = "reserved huge pages",
+		[POOL_THP] = "transparent huge pages",
+		[POOL_PAGES] = "plain pages",
+	};
+	fprintf(out, "read buffers: %s\n", backings[pool_backing(pools[0])]);
+
+	if (blockcache != NULL)
+		fprintf(out, "block cache: %zu hits, %zu misses\n",
+			blockcache_hits(blockcache), blockcache_misses(blockcache));
+
+	pthread_mutex_lock(&samples_mutex);
+	fprintf(out, "sampling: %zu compares, %zu eliminated\n", samples_compared,
+		samples_eliminated);
+	pthread_mutex_unlock(&samples_mutex);
+
+	pthread_mutex_lock(&splits_mutex);
+	fprintf(out, "range compares: %zu, %zu cut short\n", splits_compared,
+		splits_cancelled);
+	pthread_mutex_unlock(&splits_mutex);
+}
@@ -0,0 +1,195 @@
+#ifndef READER_H
+#define READER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+typedef struct _reader_config_t
+{
+	/**
+	 * Read with O_DIRECT through page aligned pool buffers so scans don't evict
+	 * the page cache of other processes. Files on filesystems that refuse
+	 * O_DIRECT, and unaligned tails, are read buffered.
+	 */
+	bool is_direct;
+
+	/**
+	 * The number of page cache pages each worker may keep alive with buffered
+	 * reads, or zero to leave the page cache unmanaged. When managed, files are
+	 * read with POSIX_FADV_SEQUENTIAL, prefetched with POSIX_FADV_WILLNEED, and
+	 * released with POSIX_FADV_DONTNEED behind the read cursor once the cap is
+	 * exceeded and when each file is done.
+	 */
+	size_t cache_pages;
+
+	/// The number of bytes to hint for prefetch ahead of the read cursor
+	size_t prefetch_size;
+
+	/**
+	 * The number of bytes read from a file at a time, rounded up to a page.
+	 * Rotational disks want runs of several MiB so that a compare alternating
+	 * between two files doesn't seek every few KiB.
+	 */
+	size_t buffer_size;
+
+	/**
+	 * Carve read buffers from 2 MiB huge pages (see pool_create_huge()) so
+	 * that compares and hashes over buffers of several MiB don't miss the TLB
+	 * every 4 KiB. Experimental: no benefit has been measured yet.
+	 */
+	bool is_huge;
+
+	/**
+	 * The number of descriptors kept open by is_same_file_id(), or zero to
+	 * derive it from the soft RLIMIT_NOFILE. The cache is created by the first
+	 * is_same_file_id() so other readers never hold its descriptors.
+	 */
+	size_t fd_cache_size;
+
+	/**
+	 * The number of bytes of file blocks shared between is_same_file_id()
+	 * calls, or zero for none. Blocks are cached by file id and block index so
+	 * the leading blocks of a file compared against many others come from disk
+	 * once.
+	 */
+	size_t block_cache_size;
+
+	/**
+	 * The number of blocks sampled from each of two large files of the same
+	 * size before they are compared, or zero to compare them outright. The
+	 * blocks are spread evenly from the start to the end of the file and read
+	 * at once, so files sharing a header are told apart without a full read.
+	 * Only files of at least SAMPLE_SPREAD times the sampled bytes are sampled.
+	 */
+	size_t sample_count;
+
+	/// The number of bytes in each sampled block, rounded up to a page
+	size_t sample_size;
+
+	/**
+	 * The number of threads comparing one pair of files larger than range_size,
+	 * or one or less to compare every pair from the calling thread alone. The
+	 * pair is split into ranges of range_size bytes that the threads take in
+	 * turn, and every range stops once any of them finds a difference. The
+	 * range_threads - 1 helpers are started by the first split compare and
+	 * shared by all of them. A helper only reads in a free read slot of the
+	 * files' devices, so a pair on a device limited to one reader is compared
+	 * by the calling thread alone.
+	 */
+	size_t range_threads;
+
+	/// The number of bytes in each range of a split compare
+	size_t range_size;
+} reader_config_t;
+
+/// Files are sampled only if the samples are this small a part of them
+#define SAMPLE_SPREAD 16
+
+/// The configuration of every reader; set it before the first read
+extern reader_config_t reader_config;
+
+/**
+ * @brief Return whether the files at @a name_1 and @a name_2 have the same
+ *        content
+ *
+ * Both files are walked by their data and hole regions (SEEK_DATA/SEEK_HOLE).
+ * A range that is a hole in both files is skipped without being read, so two
+ * sparse files with matching hole maps compare in time proportional to their
+ * allocated data rather than their apparent size.
+ *
+ * Exits if either file can't be opened.
+ */
+bool is_same_file(char *name_1, char *name_2);
+
+/**
+ * @brief Return whether the files @a id_1 at @a name_1 and @a id_2 at @a name_2
+ *        have the same content
+ *
+ * This behaves like is_same_file() except that descriptors are taken from a
+ * shared LRU cache keyed by the ids, so a file compared against many others is
+ * only opened once while it stays in the cache. Ids must uniquely identify
+ * files for the life of the process.
+ *
+ * Large files are first told apart by a digest of sampled blocks (see
+ * reader_config.sample_count), which is computed once per id, then compared
+ * by several threads at once if configured (see reader_config.range_threads).
+ */
+bool is_same_file_id(size_t id_1, char *name_1, size_t id_2, char *name_2);
+
+/**
+ * @brief Split the @a length files at @a names into classes of identical
+ *        content
+ *
+ * This is a k-way comparator: every file is read once, a block at a time in
+ * lockstep with the others, and each class is split as soon as its blocks
+ * differ. A file left alone in its class isn't read any further, so a set of
+ * k files costs one read of each rather than the k(k - 1)/2 pairs of
+ * is_same_file(). Like is_same_file() the files are walked by their data and
+ * hole regions: holes are taken as zeros without being read, so a range that
+ * is a hole in every file still being read costs nothing. The bytes read are
+ * counted in the verification statistic.
+ *
+ * classes[i] is set to the least index of a file identical to file i, which is
+ * i for a file unlike any before it. A file that can't be read is alone in its
+ * class.
+ *
+ * @return whether every file could be read
+ */
+bool is_same_files(char **names, size_t length, size_t *classes);
+
+/**
+ * @brief Receive @a size bytes of content at @a buffer
+ *
+ * If @a buffer is NULL then the content is @a size zeros from a hole that
+ * wasn't read.
+ */
+typedef void (*reader_sink_f)(void *data, const unsigned char *buffer,
+	size_t size);
+
+/**
+ * @brief Pass the whole content of the file at @a name to @a sink in order
+ *
+ * @a data is passed through to @a sink. Holes are passed as NULL buffers so
+ * that sinks can account for runs of zeros without touching them.
+ *
+ * @return whether the file could be read
+ */
+bool file_scan(char *name, reader_sink_f sink, void *data);
+
+/// Like file_scan() but only the first @a length bytes, or all if negative
+bool file_scan_head(char *name, off_t length, reader_sink_f sink, void *data);
+
+/**
+ * @brief Like file_scan() but only the @a length bytes from @a offset, or all
+ *        from @a offset if negative
+ *
+ * Ranges of one file may be scanned by several threads at once.
+ */
+bool file_scan_range(char *name, off_t offset, off_t length, reader_sink_f sink,
+	void *data);
+
+/// A reader_sink_f extending the FNV-1a hash at @a data with the content
+void digest_sink(void *data, const unsigned char *buffer, size_t size);
+
+/**
+ * @brief Compute the digest of the content of the file at @a name
+ *
+ * The digest is the 64-bit FNV-1a hash of the whole content of the file.
+ * Holes are hashed as runs of zeros without being read.
+ *
+ * @return whether the file could be read; the digest is stored in @a digest
+ */
+bool file_digest(char *name, uint64_t *digest);
+
+/**
+ * @brief Print the hit and miss counters of the reader caches, the bytes read
+ *        for verification, the memory behind the read buffers, the number of
+ *        compares the sampling stage eliminated and the number of split
+ *        compares to @a out
+ */
+void reader_print_stats(FILE *out);
+
+#endif /* READER_H */
@@ -0,0 +1,77 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "mx/common.h"
+#include "mx/string.h"
+#include "mx/vector.h"
+#include "manifest.h"
+#include "reader.h"
+#include "scan.h"
+
+/// The state of the single pass over a file
+typedef struct _scan_t
+{
+	off_t offset;
+	uint64_t partial;
+	uint64_t digest;
+} scan_t;
+
+/// Order entries by key, then by path so that a manifest is reproducible
+static int entry_cmp(const void *a, const void *b) {
+	int result = manifest_record_cmp(a, b);
+	if (result != 0)
+		return result;
+	return strcmp(((manifest_entry_t *) a)->path, ((manifest_entry_t *) b)->path);
+}
+
+static void scan_sink(void *data, const unsigned char *buffer, size_t size) {
+	scan_t *scan = data;
+
+	if (scan->offset < MANIFEST_PARTIAL_SIZE) {
+		size_t count = MX_MINIMUM(size, (size_t) (MANIFEST_PARTIAL_SIZE - scan->offset));
+		digest_sink(&scan->partial, buffer, count);
+	}
+	digest_sink(&scan->digest, buffer, size);
+	scan->offset += size;
+}
+
+bool scan_file(char *name, manifest_record_t *record) {
+	struct stat st;
+	if (stat(name, &st) != 0 || !S_ISREG(st.st_mode))
+		return false;
+
+	scan_t scan = { .offset = 0, .partial = MX_FNV1A_BASIS,
+		.digest = MX_FNV1A_BASIS };
+	if (!file_scan(name, scan_sink, &scan))
+		return false;
+
+	record->size = scan.offset;
+	record->partial = scan.partial;
+	record->digest = scan.digest;
+	record->path = 0;
+	return true;
+}
+
+int scan_main(mx_string_t *names, char *manifest) {
+	manifest_entry_t *entries = mx_vector_create(sizeof(manifest_entry_t));
+
+	for (size_t i = 0; i < mx_vector_length(names); i++) {
+		manifest_entry_t entry = { .path = names[i] };
+		if (scan_file(names[i], &entry.record))
+			entries = mx_vector_append(entries, &entry);
+	}
+
+	mx_vector_sort(entries, entry_cmp);
+	if (!manifest_save(manifest, entries))
+		exit(1);
+
+	fprintf(stderr, "%zu files written to %s\n", mx_vector_length(entries),
+		manifest);
+
+	mx_vector_delete(entries);
+	return 0;
+}
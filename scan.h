@@ -0,0 +1,27 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+
+#include "mx/string.h"
+#include "manifest.h"
+
+/**
+ * @brief Read the regular file at @a name once into the key of @a record
+ *
+ * @return whether the file could be read
+ */
+bool scan_file(char *name, manifest_record_t *record);
+
+/**
+ * @brief Write the manifest of @a names to the file at @a manifest
+ *
+ * Every file is read once for both its partial digest and its digest. The
+ * manifest is written next to @a manifest and renamed over it when complete,
+ * so a merge never reads a manifest that is still being written.
+ *
+ * @return the exit status
+ */
+int scan_main(mx_string_t *names, char *manifest);
+
+#endif /* SCAN_H */
@@ -0,0 +1,28 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SIZE 32
+
+/// The state of an incremental SHA-256 hash (FIPS 180-4)
+typedef struct _sha256_t
+{
+	uint32_t state[8];
+	uint64_t length;          // the number of bytes hashed so far
+	unsigned char block[64];  // the bytes of the partial block
+} sha256_t;
+
+void sha256_init(sha256_t *sha);
+
+/// Hash @a size bytes at @a buffer; NULL is @a size zeros
+void sha256_update(sha256_t *sha, const unsigned char *buffer, size_t size);
+
+/// Finish the hash and store the digest in @a digest
+void sha256_final(sha256_t *sha, unsigned char digest[SHA256_SIZE]);
+
+/// A reader_sink_f feeding a sha256_t
+void sha256_sink(void *data, const unsigned char *buffer, size_t size);
+
+#endif /* SHA256_H */
@@ -0,0 +1,170 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "mx/common.h"
+#include "mx/map.h"
+#include "mx/string.h"
+#include "mx/vector.h"
+#include "chunk.h"
+#include "reader.h"
+#include "similar.h"
+
+// 32 bands of 4 rows put the LSH threshold near (1/32)^(1/4) = 0.42, so pairs
+// at 0.8 collide in some band with probability 1 - (1 - 0.8^4)^32 > 0.9999
+#define SIGNATURE_LENGTH 128
+#define BANDS 32
+#define ROWS (SIGNATURE_LENGTH / BANDS)
+
+typedef struct _sketch_t
+{
+	off_t size;
+	uint64_t digest;
+	size_t chunks_length;
+	uint64_t minimums[SIGNATURE_LENGTH];
+} sketch_t;
+
+/// Both sinks of the single pass over a file
+typedef struct _scan_t
+{
+	uint64_t digest;
+	chunker_t chunker;
+} scan_t;
+
+typedef struct _band_key_t
+{
+	size_t band;
+	uint64_t hash;
+} band_key_t;
+
+typedef struct _pair_key_t
+{
+	size_t i;
+	size_t j;
+} pair_key_t;
+
+static uint64_t seeds[SIGNATURE_LENGTH];
+
+/// The splitmix64 finalizer; seeded, it stands in for a random permutation
+static uint64_t mix(uint64_t z) {
+	z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+	z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+	return z ^ (z >> 31);
+}
+
+static void scan_sink(void *data, const unsigned char *buffer, size_t size) {
+	scan_t *scan = data;
+	digest_sink(&scan->digest, buffer, size);
+	chunker_feed(&scan->chunker, buffer, size);
+}
+
+/// Read the file at @a name once for both its digest and its signature
+static bool sketch(char *name, sketch_t *sketch) {
+	struct stat st;
+	if (stat(name, &st) != 0)
+		return false;
+
+	scan_t scan = { .digest = MX_FNV1A_BASIS };
+	chunker_init(&scan.chunker);
+	if (!file_scan(name, scan_sink, &scan)) {
+		chunker_raze(&scan.chunker);
+		return false;
+	}
+	chunker_finish(&scan.chunker);
+
+	sketch->size = st.st_size;
+	sketch->digest = scan.digest;
+	sketch->chunks_length = mx_vector_length(scan.chunker.chunks);
+	for (size_t k = 0; k < SIGNATURE_LENGTH; k++)
+		sketch->minimums[k] = UINT64_MAX;
+
+	// a chunk repeated in the file only counts once, which is what Jaccard wants
+	for (size_t c = 0; c < sketch->chunks_length; c++) {
+		uint64_t digest = scan.chunker.chunks[c].digest;
+		for (size_t k = 0; k < SIGNATURE_LENGTH; k++)
+			sketch->minimums[k] = MX_MINIMUM(sketch->minimums[k], mix(digest ^ seeds[k]));
+	}
+
+	chunker_raze(&scan.chunker);
+	return true;
+}
+
+static double similarity(sketch_t *sketch_1, sketch_t *sketch_2) {
+	if (sketch_1->size == sketch_2->size && sketch_1->digest == sketch_2->digest)
+		return 1;
+
+	size_t equal = 0;
+	for (size_t k = 0; k < SIGNATURE_LENGTH; k++)
+		equal += sketch_1->minimums[k] == sketch_2->minimums[k];
+
+	// files that differ can't be identical however their signatures agree
+	return MX_MINIMUM(equal, (size_t) SIGNATURE_LENGTH - 1) / (double) SIGNATURE_LENGTH;
+}
+
+int similar_main(mx_string_t *names, double threshold) {
+	size_t names_length = mx_vector_length(names);
+
+	for (size_t k = 0; k < SIGNATURE_LENGTH; k++)
+		seeds[k] = mix(UINT64_C(0x9e3779b97f4a7c15) * (k + 1));
+
+	sketch_t *sketches = malloc(MX_MAXIMUM(names_length, (size_t) 1) * sizeof(sketch_t));
+	if (sketches == NULL)
+		abort();
+
+	mx_map_t buckets = mx_map_create(sizeof(band_key_t), sizeof(size_t *), NULL, NULL);
+	for (size_t i = 0; i < names_length; i++) {
+		// empty files have no chunks and so no signature to bucket
+		if (!sketch(names[i], &sketches[i]) || sketches[i].chunks_length == 0)
+			continue;
+
+		for (size_t band = 0; band < BANDS; band++) {
+			band_key_t key = {
+				.band = band,
+				.hash = mx_fnv1a((char *) &sketches[i].minimums[band * ROWS],
+					ROWS * sizeof(uint64_t)),
+			};
+			size_t **ids = mx_map_get(buckets, &key);
+			if (ids == NULL) {
+				size_t *empty = mx_vector_create(sizeof(size_t));
+				if ((ids = mx_map_put(buckets, &key, &empty)) == NULL)
+					abort();
+			}
+			*ids = mx_vector_append(*ids, &i);
+		}
+	}
+
+	// every pair sharing a bucket is a candidate, however many bands it shares
+	mx_map_t candidates = mx_map_create(sizeof(pair_key_t), sizeof(bool), NULL, NULL);
+	for (size_t b = 0; (b = mx_map_next(buckets, b)) != MX_ABSENT; b++) {
+		size_t *ids = *(size_t **) mx_map_value_at(buckets, b);
+		for (size_t x = 0; x < mx_vector_length(ids); x++) {
+			for (size_t y = x + 1; y < mx_vector_length(ids); y++) {
+				pair_key_t key = { .i = ids[x], .j = ids[y] };
+				bool is_candidate = true;
+				if (mx_map_put(candidates, &key, &is_candidate) == NULL)
+					abort();
+			}
+		}
+		mx_vector_delete(ids);
+	}
+	mx_map_delete(buckets);
+
+	size_t reported = 0;
+	for (size_t c = 0; (c = mx_map_next(candidates, c)) != MX_ABSENT; c++) {
+		pair_key_t *key = mx_map_key_at(candidates, c);
+		double s = similarity(&sketches[key->i], &sketches[key->j]);
+		if (s < threshold)
+			continue;
+		printf("%s, %s, %.2f\n", names[key->i], names[key->j], s);
+		reported++;
+	}
+
+	fprintf(stderr, "%zu candidate pairs, %zu at or above %.2f\n",
+		mx_map_length(candidates), reported, threshold);
+
+	mx_map_delete(candidates);
+	free(sketches);
+	return 0;
+}
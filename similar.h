@@ -0,0 +1,20 @@
+#ifndef SIMILAR_H
+#define SIMILAR_H
+
+#include "mx/string.h"
+
+/**
+ * @brief Report the pairs of @a names whose content is near-identical
+ *
+ * Every file gets a MinHash signature over its content-defined chunks, computed
+ * in the same pass as its exact digest. Signatures are bucketed band by band
+ * (locality-sensitive hashing) so only files colliding in some band are
+ * compared. Each pair whose estimated Jaccard similarity is at least
+ * @a threshold is printed as "name_1, name_2, similarity"; identical files
+ * have a similarity of exactly 1.
+ *
+ * @return the exit status
+ */
+int similar_main(mx_string_t *names, double threshold);
+
+#endif /* SIMILAR_H */
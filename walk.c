@@ -0,0 +1,66 @@
+#include <dirent.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "mx/string.h"
+#include "walk.h"
+
+/// The callbacks of a walk and whether a file callback stopped it
+typedef struct _walk_t
+{
+	walk_directory_f directory;
+	walk_file_f file;
+	void *data;
+	bool is_stopped;
+} walk_t;
+
+static bool walk_directory(walk_t *walk, const char *path) {
+	if (walk->directory != NULL && !walk->directory(walk->data, path))
+		return true;
+
+	DIR *dirp = opendir(path);
+	if (dirp == NULL) {
+		fprintf(stderr, "opendir() failed on %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	bool result = true;
+	struct dirent *dirent;
+	while (!walk->is_stopped && (dirent = readdir(dirp)) != NULL) {
+		if (strcmp(dirent->d_name, ".") == 0 || strcmp(dirent->d_name, "..") == 0)
+			continue;
+
+		mx_string_t child = mx_string_create(NULL, 0);
+		child = mx_string_catf(child, "%s/%s", path, dirent->d_name);
+
+		unsigned char type = dirent->d_type;
+		if (type == DT_UNKNOWN) {
+			struct stat st;
+			if (lstat(child, &st) == 0)
+				type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : 0;
+		}
+
+		if (type == DT_DIR)
+			result &= walk_directory(walk, child);
+		else if (type == DT_REG)
+			walk->is_stopped = !walk->file(walk->data, child);
+
+		mx_string_delete(child);
+	}
+	closedir(dirp);
+	return result;
+}
+
+bool walk_tree(const char *path, walk_directory_f directory, walk_file_f file,
+		void *data) {
+	walk_t walk = {
+		.directory = directory,
+		.file = file,
+		.data = data,
+		.is_stopped = false,
+	};
+	return walk_directory(&walk, path);
+}
@@ -0,0 +1,27 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include <stdbool.h>
+
+/**
+ * Called with the path of each directory, the root included, before its
+ * entries; return whether to walk it
+ */
+typedef bool (*walk_directory_f)(void *data, const char *path);
+
+/// Called with the path of each regular file; return whether to go on walking
+typedef bool (*walk_file_f)(void *data, const char *path);
+
+/**
+ * @brief Call @a file with every regular file beneath the directory @a path
+ *        and @a directory, if not NULL, with every directory
+ *
+ * Symbolic links are not followed. Entries whose type the file system doesn't
+ * report are typed with lstat(). The walk stops once @a file returns false.
+ *
+ * @return whether every directory walked could be read
+ */
+bool walk_tree(const char *path, walk_directory_f directory, walk_file_f file,
+	void *data);
+
+#endif /* WALK_H */
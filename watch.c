@@ -0,0 +1,219 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mx/map.h"
+#include "mx/string.h"
+#include "catalog.h"
+#include "walk.h"
+#include "watch.h"
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+	IN_MOVED_TO | IN_ONLYDIR)
+
+static int inotify_fd;
+static mx_map_t watches; // watch descriptor -> mx_string_t directory path
+
+/// Watch the directory @a path; its entries are walked only if it is watched
+static bool watch_directory(void *data, const char *path) {
+	(void) data;
+	int wd = inotify_add_watch(inotify_fd, path, WATCH_MASK);
+	if (wd < 0) {
+		fprintf(stderr, "inotify_add_watch() failed on %s: %s\n", path,
+			strerror(errno));
+		return false;
+	}
+
+	mx_string_t *watched = mx_map_get(watches, &wd);
+	if (watched != NULL)
+		mx_string_delete(*watched);
+	mx_string_t name = mx_string_create((char *) path, 0);
+	if (mx_map_put(watches, &wd, &name) == NULL)
+		abort();
+	return true;
+}
+
+static bool catalog_file(void *data, const char *path) {
+	catalog_update(data, (char *) path);
+	return true;
+}
+
+/**
+ * Watch @a path and every directory beneath it and catalog their files
+ *
+ * @return whether every directory could be read
+ */
+static bool watch_tree(catalog_t *catalog, char *path) {
+	return walk_tree(path, watch_directory, catalog_file, catalog);
+}
+
+/// Stop watching the directories that are gone, whose removal may have been lost
+static void prune_watches(void) {
+	for (size_t i = 0; (i = mx_map_next(watches, i)) != MX_ABSENT; i++) {
+		mx_string_t name = *(mx_string_t *) mx_map_value_at(watches, i);
+		struct stat st;
+		if (stat(name, &st) == 0 && S_ISDIR(st.st_mode))
+			continue;
+
+		int wd = *(int *) mx_map_key_at(watches, i);
+		inotify_rm_watch(inotify_fd, wd);
+		mx_string_delete(name);
+		mx_map_remove(watches, &wd);
+	}
+}
+
+/// Stop watching @a path and every directory beneath it
+static void unwatch_tree(char *path) {
+	size_t length = strlen(path);
+
+	for (size_t i = 0; (i = mx_map_next(watches, i)) != MX_ABSENT; i++) {
+		mx_string_t name = *(mx_string_t *) mx_map_value_at(watches, i);
+		if (strncmp(name, path, length) != 0)
+			continue;
+		if (name[length] != '\0' && name[length] != '/')
+			continue;
+
+		int wd = *(int *) mx_map_key_at(watches, i);
+		inotify_rm_watch(inotify_fd, wd);
+		mx_string_delete(name);
+		mx_map_remove(watches, &wd);
+	}
+}
+
+static void handle_event(catalog_t *catalog, struct inotify_event *event) {
+	if (event->mask & IN_IGNORED) {
+		mx_string_t *name = mx_map_get(watches, &event->wd);
+		if (name != NULL) {
+			mx_string_delete(*name);
+			mx_map_remove(watches, &event->wd);
+		}
+		return;
+	}
+
+	mx_string_t *directory = mx_map_get(watches, &event->wd);
+	if (directory == NULL || event->len == 0)
+		return;
+
+	mx_string_t path = mx_string_create(NULL, 0);
+	path = mx_string_catf(path, "%s/%s", *directory, event->name);
+
+	if (event->mask & IN_ISDIR) {
+		if (event->mask & (IN_CREATE | IN_MOVED_TO))
+			watch_tree(catalog, path);
+		else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+			unwatch_tree(path);
+			catalog_remove_tree(catalog, path);
+		}
+	} else {
+		if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+			catalog_update(catalog, path);
+		else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+			catalog_remove(catalog, path);
+	}
+
+	mx_string_delete(path);
+}
+
+/// Answer the query on @a line: a path prints its set; nothing prints all sets
+static void handle_query(catalog_t *catalog, char *line) {
+	if (line[0] == '\0')
+		catalog_print_sets(catalog, stdout);
+	else {
+		size_t id = catalog_find(catalog, line);
+		if (id != MX_ABSENT)
+			catalog_print_set(catalog, id, stdout);
+	}
+
+	// an empty line terminates every answer
+	printf("\n");
+	fflush(stdout);
+}
+
+int watch_main(char **roots, size_t roots_length) {
+	if ((inotify_fd = inotify_init1(IN_CLOEXEC)) < 0) {
+		fprintf(stderr, "inotify_init1() failed: %s\n", strerror(errno));
+		return 1;
+	}
+
+	watches = mx_map_create(sizeof(int), sizeof(mx_string_t), NULL, NULL);
+	catalog_t *catalog = catalog_create();
+
+	// the sweep starts a new generation so a rescan can tell which files are gone
+	catalog->is_deferred = true;
+	for (size_t i = 0; i < roots_length; i++)
+		watch_tree(catalog, roots[i]);
+	catalog_sweep(catalog);
+	catalog_flush(catalog);
+
+	catalog_print_sets(catalog, stdout);
+	printf("\n");
+	fflush(stdout);
+
+	struct pollfd fds[2] = {
+		{ .fd = inotify_fd, .events = POLLIN },
+		{ .fd = STDIN_FILENO, .events = POLLIN },
+	};
+	mx_string_t pending = mx_string_create(NULL, 0);
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	while (true) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "poll() failed: %s\n", strerror(errno));
+			break;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			ssize_t size = read(inotify_fd, buffer, sizeof(buffer));
+			for (char *p = buffer; p < buffer + size;) {
+				struct inotify_event *event = (struct inotify_event *) p;
+
+				// events were lost so rewalk the roots, which rehashes only the
+				// files that changed, and sweep away the files that are gone
+				if (event->mask & IN_Q_OVERFLOW) {
+					fprintf(stderr, "inotify queue overflowed; rescanning\n");
+					catalog->is_deferred = true;
+					bool is_walked = true;
+					for (size_t i = 0; i < roots_length; i++)
+						is_walked &= watch_tree(catalog, roots[i]);
+					if (is_walked)
+						catalog_sweep(catalog);
+					catalog_flush(catalog);
+					prune_watches();
+				} else
+					handle_event(catalog, event);
+
+				p += sizeof(struct inotify_event) + event->len;
+			}
+		}
+
+		// read stdin unbuffered so that poll() sees every line that's pending
+		if (fds[1].revents & (POLLIN | POLLHUP)) {
+			ssize_t size = read(STDIN_FILENO, buffer, sizeof(buffer));
+			if (size <= 0)
+				fds[1].fd = -1; // keep watching without queries
+			else
+				pending = mx_string_extend(pending, buffer, size);
+
+			char *newline;
+			while ((newline = memchr(pending, '\n', mx_string_length(pending)))) {
+				*newline = '\0';
+				handle_query(catalog, pending);
+				pending = mx_string_excise(pending, 0, newline - pending + 1);
+			}
+		}
+	}
+
+	mx_string_delete(pending);
+	catalog_delete(catalog);
+	mx_map_delete(watches);
+	close(inotify_fd);
+	return 1;
+}
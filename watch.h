@@ -0,0 +1,21 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stddef.h>
+
+/**
+ * @brief Catalog every file under @a roots then keep the catalog up to date
+ *
+ * After the initial scan the duplicate sets are printed. Afterwards inotify
+ * events under @a roots are applied to the catalog as they arrive so only
+ * created, modified or moved files are rehashed.
+ *
+ * Queries are read from stdin one per line. A path prints the set that file is
+ * in; an empty line prints every duplicate set. Each answer is terminated by an
+ * empty line.
+ *
+ * @return only on failure, with a nonzero exit status
+ */
+int watch_main(char **roots, size_t roots_length);
+
+#endif /* WATCH_H */